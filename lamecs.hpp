@@ -2,15 +2,43 @@
 #define LAMECS_H
 
 #include <algorithm>
+#include <atomic>
 #include <bitset>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <iostream> 
 #include <limits>
+#include <map>
 #include <memory>
+#include <new>
+#include <numeric>
+#include <optional>
 #include <unordered_map>
 #include <queue>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
 #include <typeinfo>
+#include <utility>
+#include <variant>
 #include <vector>
 
+// shm_set/shm_reader pull POSIX headers (and names like acct() or link()) into every includer, so they are opt in
+#if defined(LAMECS_ENABLE_SHM) && __has_include(<sys/mman.h>)
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#define LAMECS_SHM
+#endif
+
 #ifndef LAMECS_ASSERTS
 	#define LAMECS_ASSERT(condition, msg) \
 		if (condition) { \
@@ -25,6 +53,13 @@
 		#define LAMECS_INFO(msg);
 	#endif
 #endif
+#ifndef LAMECS_PREFETCH
+	#if defined(__GNUC__) || defined(__clang__)
+		#define LAMECS_PREFETCH(addr) __builtin_prefetch(addr)
+	#else
+		#define LAMECS_PREFETCH(addr)
+	#endif
+#endif
 
 namespace lamecs
 {
@@ -36,14 +71,37 @@ constexpr size_t MAX_ENTITY_COUNT    = 100000;
 constexpr size_t ENTITY_CHUNK_SIZE   = 1000;
 constexpr size_t MAX_COMPONENT_COUNT = 64;
 
+// external id map parameters
+constexpr size_t EXTERNAL_ID_MIN_CAPACITY = 64;
+
+// chunk iteration parameters
+constexpr size_t ITERATION_CHUNK_SIZE = 4096;
+constexpr size_t BUDGET_CLOCK_STRIDE  = 32;
+
+// dense storage parameters
+constexpr size_t SIMD_ALIGNMENT = 64;
+
 // sparse set parameters
 constexpr size_t DENSE_SET_CHUNK_SIZE = 3200;
+constexpr size_t DENSE_SET_PAGE_SIZE  = ITERATION_CHUNK_SIZE; // chunks of .each_chunk() never cross a page
 constexpr size_t SPARSE_PAGINATION_CHUNK_SIZE = 1600;
 
+// paged set parameters
+constexpr size_t PAGED_SET_PAGE_SIZE = 1024;
+
+// shared memory set parameters
+constexpr size_t SHM_SET_MIN_CAPACITY = 1024;
+
 // custom types
 using entity_id = unsigned int;
 using component_type   = const char*; 
-using component_bitset = std::bitset<MAX_COMPONENT_COUNT>;
+using component_bitset = std::bitset<MAX_COMPONENT_COUNT + 1>;
+
+// distance in ids between prefetching and reading in batched lookups, sparse slots are fetched twice as far ahead
+constexpr size_t PREFETCH_DISTANCE = 8;
+
+// extra bit after the component bits, disabled entities have it set so they live in groups of their own
+constexpr size_t DISABLED_BIT = MAX_COMPONENT_COUNT;
 
 constexpr entity_id null_entity = std::numeric_limits<entity_id>::max();
 
@@ -54,343 +112,3782 @@ public:
     virtual void push() {}
     virtual void remove(entity_id id) { }
     virtual bool contains(entity_id id) { return 0; }
+    virtual size_t size() { return 0; }
+    virtual std::shared_ptr<sparse_set_interface> clone() = 0;
+    virtual std::shared_ptr<sparse_set_interface> make_empty() = 0;
+    // moves the component of from[i] into target (a pool of the same type) as to[i], ids in to must not be in target yet
+    virtual void transfer(sparse_set_interface& target, std::span<const entity_id> from, std::span<const entity_id> to) = 0;
+    virtual bool double_buffered() { return false; }
+    virtual void swap_buffers() {}
+    // pools other processes read (a published shm_set) bracket writes made through references, the rest ignore it
+    virtual void begin_write() {}
+    virtual void end_write() {}
+    // such pools are never shared with a fork or snapshot, the registry that published them keeps them
+    virtual bool process_shared() { return false; }
 };
 
-template <typename C>
-class sparse_set : public sparse_set_interface
+// paginated entity id -> dense index lookup shared by the pools below
+class sparse_index
 {
 private:
-    std::vector<size_t> dense_to_sparse_arr_;
-    std::vector<C> dense_arr_;
-    std::vector<std::vector<size_t>> sparse_arr_;
+    std::vector<std::vector<size_t>> pages_;
 
-    size_t get_dense_index(entity_id id)
+public:
+    size_t get(entity_id id) const
     {
         size_t page = id / SPARSE_PAGINATION_CHUNK_SIZE;
         size_t idx  = id % SPARSE_PAGINATION_CHUNK_SIZE;
 
-        if(page < sparse_arr_.size())
-            if(idx < sparse_arr_[page].size())
-                return sparse_arr_[page][idx];
+        if(page < pages_.size())
+            if(idx < pages_[page].size())
+                return pages_[page][idx];
         return tombstone;
     }
 
-    void set_dense_index(entity_id id, size_t item)
+    void set(entity_id id, size_t item)
     {
         size_t page = id / SPARSE_PAGINATION_CHUNK_SIZE;
         size_t idx  = id % SPARSE_PAGINATION_CHUNK_SIZE;
 
-        if(page >= sparse_arr_.size()) 
-            sparse_arr_.resize(page + 1); 
-        if(idx  >= sparse_arr_[page].size()) 
-            sparse_arr_[page].resize(SPARSE_PAGINATION_CHUNK_SIZE, tombstone);
+        if(page >= pages_.size()) 
+            pages_.resize(page + 1); 
+        if(idx  >= pages_[page].size()) 
+            pages_[page].resize(SPARSE_PAGINATION_CHUNK_SIZE, tombstone);
+
+        pages_[page][idx] = item;
+    }
 
-        sparse_arr_[page][idx] = item;
+    // hints the cache about the slot of id so a later get() does not miss
+    void prefetch(entity_id id) const
+    {
+        size_t page = id / SPARSE_PAGINATION_CHUNK_SIZE;
+        if(page < pages_.size() && !pages_[page].empty()) { LAMECS_PREFETCH(pages_[page].data() + id % SPARSE_PAGINATION_CHUNK_SIZE); }
     }
 
-    void push_to_dense(C item) // change to set index style
+    void clear() { pages_.clear(); }
+};
+
+// contiguous dense storage aligned to SIMD_ALIGNMENT, capacity is kept at a multiple of the simd lane count
+// so for trivially copyable T reading up to padded_size() never leaves the allocation (unused lanes start zeroed)
+// lanes is the smallest item count spanning whole SIMD_ALIGNMENT blocks, 16 for a 12 byte T, so the last block is never cut off
+template <typename T>
+class aligned_vector
+{
+private:
+    static constexpr size_t alignment = std::max(SIMD_ALIGNMENT, alignof(T));
+    static constexpr size_t lanes     = SIMD_ALIGNMENT / std::gcd(SIMD_ALIGNMENT, sizeof(T));
+
+    T* data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+
+    static size_t round_to_lanes(size_t count) { return (count + lanes - 1) / lanes * lanes; }
+
+    static T* allocate(size_t count) { return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(alignment))); }
+
+    static void deallocate(T* ptr) { ::operator delete(ptr, std::align_val_t(alignment)); }
+
+    void reallocate(size_t new_capacity)
     {
-        if(dense_arr_.capacity() <= dense_arr_.size()) 
+        new_capacity = round_to_lanes(new_capacity);
+        T* new_data = allocate(new_capacity);
+
+        if constexpr(std::is_trivially_copyable_v<T>)
+        {
+            if(size_ > 0) { std::memcpy(static_cast<void*>(new_data), data_, size_ * sizeof(T)); }
+        }
+        else
         {
-            dense_arr_.reserve(dense_arr_.capacity() + DENSE_SET_CHUNK_SIZE);    
-            dense_to_sparse_arr_.reserve(dense_arr_.capacity() + DENSE_SET_CHUNK_SIZE);   
+            for(size_t i = 0; i < size_; i++)
+            {
+                new (new_data + i) T(std::move(data_[i]));
+                data_[i].~T();
+            }
         }
+        std::memset(static_cast<void*>(new_data + size_), 0, (new_capacity - size_) * sizeof(T));
 
-        dense_arr_.push_back(item);
+        deallocate(data_);
+        data_ = new_data;
+        capacity_ = new_capacity;
     }
 
 public:
+    aligned_vector() = default;
 
-    sparse_set() = default;
+    aligned_vector(const aligned_vector& other)
+    {
+        reserve(other.size_);
+        for(size_t i = 0; i < other.size_; i++) { new (data_ + i) T(other.data_[i]); }
+        size_ = other.size_;
+    }
 
-    C* set(entity_id id, C item)
+    aligned_vector(aligned_vector&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)), capacity_(std::exchange(other.capacity_, 0)) {}
+
+    aligned_vector& operator=(aligned_vector other) noexcept
     {
-        size_t index = get_dense_index(id);
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+        return *this;
+    }
 
-        if(index == tombstone)
-        {
-            push(id, item);
-            return &dense_arr_.back();
-        }
+    ~aligned_vector()
+    {
+        clear();
+        deallocate(data_);
+    }
 
-        dense_arr_[index] = item;
-        dense_to_sparse_arr_[index] = id;
-        return &dense_arr_[index];
+    void reserve(size_t new_capacity)
+    {
+        if(new_capacity > capacity_) { reallocate(new_capacity); }
     }
 
-    void push(entity_id id, C item)
+    // grows geometrically like push_back(), so growing one element at a time stays amortised O(1)
+    void resize(size_t new_size)
     {
-        set_dense_index(id, dense_arr_.size());
-        push_to_dense(item);  
-        dense_to_sparse_arr_.push_back(dense_arr_.size());
+        if(new_size > capacity_) { reallocate(std::max(new_size, capacity_ * 2)); }
+        for(size_t i = size_; i < new_size; i++) { new (data_ + i) T(); }
+        for(size_t i = new_size; i < size_; i++) { data_[i].~T(); }
+        size_ = new_size;
     }
 
-    void remove(entity_id id)
+    void push_back(T item)
     {
-        size_t deleted_dense_index = get_dense_index(id);
-        
-        if(deleted_dense_index == tombstone || dense_arr_.empty()) { return; }
-        
-        set_dense_index(id, tombstone);
-        set_dense_index(dense_to_sparse_arr_.back(), deleted_dense_index);
+        if(size_ == capacity_) { reallocate(std::max<size_t>(capacity_ * 2, lanes)); }
+        new (data_ + size_) T(std::move(item));
+        size_++;
+    }
 
-        std::swap(dense_arr_[deleted_dense_index], dense_arr_.back());
-        std::swap(dense_to_sparse_arr_[deleted_dense_index], dense_to_sparse_arr_.back());
+    void pop_back()
+    {
+        size_--;
+        data_[size_].~T();
+    }
 
-        dense_arr_.pop_back();
-        dense_to_sparse_arr_.pop_back();
+    // copies count items to the end, trivially copyable items are copied in one go
+    void append(const T* items, size_t count)
+    {
+        reserve(size_ + count);
+        if constexpr(std::is_trivially_copyable_v<T>)
+            std::memcpy(static_cast<void*>(data_ + size_), items, count * sizeof(T));
+        else
+            for(size_t i = 0; i < count; i++) { new (data_ + size_ + i) T(items[i]); }
+        size_ += count;
     }
 
-    C& operator[](entity_id id)
+    // removes the element at index by relocating the last element into the hole
+    void swap_and_pop(size_t index)
     {
-        size_t idx = get_dense_index(id);
-        LAMECS_ASSERT(idx == tombstone, "Sparse set does not contain type " << typeid(C).name() << " for entity: " << id); 
-        return dense_arr_[idx];        
+        if(index != size_ - 1)
+        {
+            if constexpr(std::is_trivially_copyable_v<T>)
+                std::memcpy(static_cast<void*>(data_ + index), data_ + size_ - 1, sizeof(T));
+            else
+                data_[index] = std::move(data_[size_ - 1]);
+        }
+        pop_back();
     }
 
     void clear()
     {
-        sparse_arr_.clear();
-        dense_arr_.clear();
-        dense_to_sparse_arr_.clear();
+        if constexpr(!std::is_trivially_destructible_v<T>)
+            for(size_t i = 0; i < size_; i++) { data_[i].~T(); }
+        size_ = 0;
     }
-    
-    bool contains(entity_id id) { return get_dense_index(id) != tombstone; }
 
-    bool empty() { return dense_arr_.size() == 0; }
+    T& operator[](size_t index) { return data_[index]; }
+    const T& operator[](size_t index) const { return data_[index]; }
+
+    T& back() { return data_[size_ - 1]; }
 
-    const std::vector<C>& data() { return dense_arr_; }
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+
+    T* begin() { return data_; }
+    T* end() { return data_ + size_; }
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+
+    size_t size() const { return size_; }
+    size_t padded_size() const { return round_to_lanes(size_); }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
 };
 
-class registry
+// dense storage cut into DENSE_SET_PAGE_SIZE pages that copies share, copying is O(pages) and a page is copied on its first write
+// const access never copies, mutable access copies the page first when another copy still holds it
+// pages start small and grow geometrically up to DENSE_SET_PAGE_SIZE, so small sets (e.g. groups) stay small
+template <typename T>
+class cow_vector
 {
-private:    
-    std::queue<entity_id> available_entity_ids_;
-    std::vector<std::unique_ptr<sparse_set_interface>> component_pools_; //index of specific components pool is its position in component bitset (component_bit_positions_[component_type])
-    std::unordered_map<component_bitset, sparse_set<entity_id>> enitity_groups_;
-    std::unordered_map<component_type, size_t> component_bit_positions_;
-    sparse_set<component_bitset> component_bitsets_;
+private:
+    using page = aligned_vector<T>;
 
-    size_t entity_limit_ = 0;
+    std::vector<std::shared_ptr<page>> pages_;
+    size_t size_ = 0;
 
-    template<typename C>
-    size_t get_component_position()
+    page& writable_page(size_t index)
     {
-        component_type type = get_component_type<C>();
-        if(!component_bit_positions_.contains(type)) { return tombstone; }
-        return component_bit_positions_.at(type);
+        std::shared_ptr<page>& shared = pages_[index];
+        if(shared.use_count() > 1) { shared = std::make_shared<page>(*shared); }
+        return *shared;
     }
 
-    template<typename C>
-    sparse_set<C>& get_component_pool(bool register_when_not_found = true)
+    page& last_page_with_room()
     {
-        if(get_component_position<C>() == tombstone)
-        {
-            LAMECS_ASSERT(!register_when_not_found, "registry dont have component type: " << typeid(C).name());
-            register_component<C>();
-        }
-
-        sparse_set_interface* generic_ptr = component_pools_[get_component_position<C>()].get();
-        return *dynamic_cast<sparse_set<C>*>(generic_ptr);
+        if(size_ % DENSE_SET_PAGE_SIZE == 0) { pages_.push_back(std::make_shared<page>()); }
+        return writable_page(pages_.size() - 1);
     }
 
-    component_bitset& get_component_bitset(entity_id id, bool create_when_not_found = true)
+public:
+    T& operator[](size_t index) { return writable_page(index / DENSE_SET_PAGE_SIZE)[index % DENSE_SET_PAGE_SIZE]; }
+
+    const T& read(size_t index) const { return (*pages_[index / DENSE_SET_PAGE_SIZE])[index % DENSE_SET_PAGE_SIZE]; }
+
+    const T* address(size_t index) const { return pages_[index / DENSE_SET_PAGE_SIZE]->data() + index % DENSE_SET_PAGE_SIZE; }
+
+    T& back() { return (*this)[size_ - 1]; }
+
+    void push_back(T item)
     {
-        if(!component_bitsets_.contains(id))
-        {
-            if(create_when_not_found) { component_bitsets_.push(id, component_bitset()); }
-            else { LAMECS_ASSERT(true, "Entity: " << id << " does not exist"); } // currently we wont hit with this situation but get_component_pool() also does similar stuff so why not adding this ?
-        }
-        return component_bitsets_[id];
+        page& last = last_page_with_room();
+        if(last.size() == last.capacity()) { last.reserve(std::min(std::max<size_t>(last.capacity() * 2, 8), DENSE_SET_PAGE_SIZE)); }
+        last.push_back(std::move(item));
+        size_++;
     }
 
-    template<typename C>
-    void set_bitset_bit(component_bitset& bitset, bool value) 
-    { 
-        size_t bitset_position = get_component_position<C>();
-        LAMECS_ASSERT(bitset_position == tombstone, "registry dont have component type: " << typeid(C).name());
-        bitset[bitset_position] = value;
+    void pop_back()
+    {
+        writable_page(pages_.size() - 1).pop_back();
+        size_--;
+        if(size_ % DENSE_SET_PAGE_SIZE == 0) { pages_.pop_back(); }
     }
 
-    template<typename... Components> 
-    component_bitset get_component_bitset_mask()
+    void swap_and_pop(size_t index)
     {
-        component_bitset mask;
-        (set_bitset_bit<Components>(mask, 1), ...);
-        return mask;
-    }   
+        if(index != size_ - 1) { (*this)[index] = std::move(back()); }
+        pop_back();
+    }
 
-    void remove_entity_from_group(component_bitset bitset, entity_id id)
+    // copies count items to the end, a page at a time
+    void append(const T* items, size_t count)
     {
-        enitity_groups_.emplace(std::piecewise_construct,
-				std::forward_as_tuple(bitset),
-				std::forward_as_tuple());
-        sparse_set<entity_id>& group = enitity_groups_.at(bitset);
-        group.remove(id);
-        if(group.empty()) { enitity_groups_.erase(bitset); }
+        while(count > 0)
+        {
+            page& last = last_page_with_room();
+            size_t n = std::min(count, DENSE_SET_PAGE_SIZE - size_ % DENSE_SET_PAGE_SIZE);
+            last.append(items, n);
+            items += n;
+            count -= n;
+            size_ += n;
+        }
     }
 
-    void add_entity_to_group(component_bitset bitset, entity_id id)
+    void clear()
     {
-        enitity_groups_.emplace(std::piecewise_construct,
-				std::forward_as_tuple(bitset),
-				std::forward_as_tuple());
-        enitity_groups_[bitset].push(id, id);
+        pages_.clear();
+        size_ = 0;
     }
 
-    bool generate_available_entity_chuck()
+    // [offset, offset + count) must not cross a page, chunks of DENSE_SET_PAGE_SIZE starting at 0 never do
+    std::span<T> span(size_t offset, size_t count)
     {
-        if(entity_limit_ == MAX_ENTITY_COUNT) { return false; }
-        size_t new_limit = std::min(entity_limit_+ENTITY_CHUNK_SIZE, MAX_ENTITY_COUNT);
-        for(entity_id i = entity_limit_; i < new_limit; i++) { available_entity_ids_.push(i); }
-        entity_limit_ = new_limit;
-        return true;
+        LAMECS_ASSERT(count > 0 && offset / DENSE_SET_PAGE_SIZE != (offset + count - 1) / DENSE_SET_PAGE_SIZE, "Span crosses a page boundary");
+        if(count == 0) { return {}; }
+        return std::span<T>(writable_page(offset / DENSE_SET_PAGE_SIZE).data() + offset % DENSE_SET_PAGE_SIZE, count);
     }
 
-    template<typename C>
-    C& get(entity_id id)
+    std::span<const T> span(size_t offset, size_t count) const
     {
-        sparse_set<C>& pool = get_component_pool<C>(false);
-        LAMECS_ASSERT(!contains_entity(id), "Entity: " << id << " does not exist during .get() call");
-        LAMECS_ASSERT(!pool.contains(id), "Entity: " << id << " does not have component " << get_component_type<C>() << " during .get() call");
-        return pool[id];
+        LAMECS_ASSERT(count > 0 && offset / DENSE_SET_PAGE_SIZE != (offset + count - 1) / DENSE_SET_PAGE_SIZE, "Span crosses a page boundary");
+        if(count == 0) { return {}; }
+        return std::span<const T>(pages_[offset / DENSE_SET_PAGE_SIZE]->data() + offset % DENSE_SET_PAGE_SIZE, count);
     }
 
-    template<typename C>
-    inline component_type get_component_type() { return typeid(C).name(); }
+    size_t page_count() const { return pages_.size(); }
 
-    inline bool contains_entity(entity_id id) { return component_bitsets_.contains(id); }
+    std::span<const T> page_items(size_t index) const { return std::span<const T>(pages_[index]->data(), pages_[index]->size()); }
 
-public:
-    registry() 
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+};
+
+// tag for registry::register_component<C>(double_buffered)
+struct double_buffered_t {};
+inline constexpr double_buffered_t double_buffered{};
+
+// dense storage is split into an active prefix [0, active_size()) and a cold suffix, new items start active
+// a double buffered set keeps a second dense array for next(), both arrays share the same index layout
+// copies share dense pages, operator[] copies a shared page before handing out a reference and read() never does
+template <typename C>
+class sparse_set : public sparse_set_interface
+{
+private:
+    std::vector<entity_id> dense_to_sparse_arr_;
+    cow_vector<C> dense_arr_;
+    cow_vector<C> next_arr_; // empty unless double buffered
+    sparse_index sparse_arr_;
+    size_t active_size_ = 0;
+    bool double_buffered_ = false;
+
+    size_t get_dense_index(entity_id id) { return sparse_arr_.get(id); }
+
+    void set_dense_index(entity_id id, size_t item) { sparse_arr_.set(id, item); }
+
+    void swap_dense(size_t a, size_t b)
     {
-        generate_available_entity_chuck();
+        std::swap(dense_arr_[a], dense_arr_[b]);
+        if(double_buffered_) { std::swap(next_arr_[a], next_arr_[b]); }
+        std::swap(dense_to_sparse_arr_[a], dense_to_sparse_arr_[b]);
+        set_dense_index(dense_to_sparse_arr_[a], a);
+        set_dense_index(dense_to_sparse_arr_[b], b);
     }
 
-    template <typename C>
-    void emplace(entity_id id, C&& component={})
+    void push_to_dense(C&& item) // change to set index style
     {
-        if(id == null_entity)
-        {
-            LAMECS_INFO("Entity is not valid");
-            return;
-        }
-
-        sparse_set<C>& pool = get_component_pool<C>();
-        pool.set(id, component);
-        component_bitset& bitset = get_component_bitset(id);
-        remove_entity_from_group(bitset, id);
-        set_bitset_bit<C>(bitset, 1);
-        add_entity_to_group(bitset, id);
+        if(dense_to_sparse_arr_.capacity() <= dense_to_sparse_arr_.size()) { dense_to_sparse_arr_.reserve(dense_to_sparse_arr_.capacity() + DENSE_SET_CHUNK_SIZE); }
+        dense_arr_.push_back(std::move(item));
     }
 
-    template <typename C>
-    void remove(entity_id id)
-    {
-        if(!contains_entity(id))
-        {
-            LAMECS_INFO("Entity: " << id << " does not exist");
-            return;
-        }
+public:
+    using reference = C&;
+    using pointer   = C*;
 
-        sparse_set<C>& pool = get_component_pool<C>();
-        pool.remove(id);
-        component_bitset& bitset = get_component_bitset(id, false);
-        remove_entity_from_group(bitset, id);
-        set_bitset_bit<C>(bitset, 0);
-        add_entity_to_group(bitset, id);
-    }
+    sparse_set() = default;
 
-    void remove_entity(entity_id &id)
+    C* set(entity_id id, C item)
     {
-        if(!contains_entity(id))
+        size_t index = get_dense_index(id);
+
+        if(index == tombstone)
         {
-            LAMECS_INFO("Entity: " << id << " does not exist");
-            return;
+            push(id, std::move(item));
+            return &dense_arr_[get_dense_index(id)];
         }
 
-        component_bitset deleted_bitset = get_component_bitset(id);
-        component_bitsets_.remove(id);
-        available_entity_ids_.push(id);
-        remove_entity_from_group(deleted_bitset, id);
-        for(size_t i = 0; i < MAX_COMPONENT_COUNT; i++)
-            if(deleted_bitset[i] == 1) { component_pools_[i]->remove(id); }
+        dense_arr_[index] = std::move(item);
+        if(double_buffered_) { next_arr_[index] = dense_arr_[index]; }
+        dense_to_sparse_arr_[index] = id;
+        return &dense_arr_[index];
     }
 
-    template<typename C>
-    void register_component()
+    void push(entity_id id, C item)
     {
-        LAMECS_ASSERT(component_bit_positions_.size() > MAX_COMPONENT_COUNT, "Maximum component limit reached, cant register component");
-        component_bit_positions_[get_component_type<C>()] = component_pools_.size();
-        component_pools_.push_back(std::make_unique<sparse_set<C>>()); 
+        set_dense_index(id, dense_arr_.size());
+        push_to_dense(std::move(item));  
+        if(double_buffered_) { next_arr_.push_back(dense_arr_.back()); }
+        dense_to_sparse_arr_.push_back(id);
+
+        if(active_size_ != dense_arr_.size() - 1) { swap_dense(active_size_, dense_arr_.size() - 1); }
+        active_size_++;
     }
 
-    entity_id create_entity()
+    void remove(entity_id id)
     {
-        if(available_entity_ids_.empty())
+        size_t deleted_dense_index = get_dense_index(id);
+        
+        if(deleted_dense_index == tombstone || dense_arr_.empty()) { return; }
+
+        // move the hole to the end of the active prefix first so the prefix stays contiguous
+        if(deleted_dense_index < active_size_)
         {
-            if(!generate_available_entity_chuck())
+            active_size_--;
+            if(active_size_ != dense_arr_.size() - 1)
             {
-                LAMECS_INFO("Maximum enitity limit reached, cant create entity");
-                return null_entity;
+                swap_dense(deleted_dense_index, active_size_);
+                deleted_dense_index = active_size_;
             }
         }
+        
+        set_dense_index(dense_to_sparse_arr_.back(), deleted_dense_index);
+        set_dense_index(id, tombstone);
 
-        entity_id id = available_entity_ids_.front();
-        available_entity_ids_.pop();
-        return id;
+        dense_arr_.swap_and_pop(deleted_dense_index);
+        if(double_buffered_) { next_arr_.swap_and_pop(deleted_dense_index); }
+        dense_to_sparse_arr_[deleted_dense_index] = dense_to_sparse_arr_.back();
+        dense_to_sparse_arr_.pop_back();
     }
 
-    template<typename ...Components>
-    std::tuple<Components&...> get_entity(entity_id id)
-    { 
-        LAMECS_ASSERT(!contains_entity(id), "Entity does not exist in .get_entity()");
-        return std::tuple<Components&...>(get<Components>(id)...);
+    C& operator[](entity_id id)
+    {
+        size_t idx = get_dense_index(id);
+        LAMECS_ASSERT(idx == tombstone, "Sparse set does not contain type " << typeid(C).name() << " for entity: " << id); 
+        return dense_arr_[idx];        
     }
 
-    template<typename ...Components>
-    std::vector<std::tuple<entity_id, Components&...>> view()
+    C* try_get(entity_id id)
     {
-        std::vector<std::tuple<entity_id, Components&...>> result;
-        const component_bitset& target_mask = get_component_bitset_mask<Components...>();
+        size_t idx = get_dense_index(id);
+        return idx == tombstone ? nullptr : &dense_arr_[idx];
+    }
 
-        for(auto&[mask, group] : enitity_groups_)
-        {
-            if((mask & target_mask) == target_mask)
-            {
-                for(auto id : group.data()) { result.emplace_back(id, get<Components>(id)...); }   
-            }
-        }
+    const C& read(entity_id id)
+    {
+        size_t idx = get_dense_index(id);
+        LAMECS_ASSERT(idx == tombstone, "Sparse set does not contain type " << typeid(C).name() << " for entity: " << id); 
+        return dense_arr_.read(idx);
+    }
 
-        return result;
+    const C* try_read(entity_id id)
+    {
+        size_t idx = get_dense_index(id);
+        return idx == tombstone ? nullptr : &dense_arr_.read(idx);
     }
 
-    template<typename ...Components, typename Func>
-    void each(Func&& func)
+    // moves id into the active prefix with a single swap
+    void promote(entity_id id)
     {
-        const component_bitset& target_mask = get_component_bitset_mask<Components...>();
+        size_t index = get_dense_index(id);
+        if(index == tombstone || index < active_size_) { return; }
+        swap_dense(index, active_size_);
+        active_size_++;
+    }
 
-        for(auto& [mask, group] : enitity_groups_)
-        {
-            if((mask & target_mask) == target_mask)
+    // moves id into the cold suffix with a single swap
+    void demote(entity_id id)
+    {
+        size_t index = get_dense_index(id);
+        if(index == tombstone || index >= active_size_) { return; }
+        active_size_--;
+        swap_dense(index, active_size_);
+    }
+
+    bool is_active(entity_id id) { return get_dense_index(id) < active_size_; }
+
+    // next values start out as copies of the current ones
+    void enable_double_buffering()
+    {
+        if(double_buffered_) { return; }
+        next_arr_ = dense_arr_;
+        double_buffered_ = true;
+    }
+
+    bool double_buffered() { return double_buffered_; }
+
+    // value that becomes current after the next swap_buffers(), operator[] keeps returning the current one
+    C& next(entity_id id)
+    {
+        size_t idx = get_dense_index(id);
+        LAMECS_ASSERT(!double_buffered_ || idx == tombstone, "Sparse set is not double buffered or does not contain type " << typeid(C).name() << " for entity: " << id); 
+        return next_arr_[idx];
+    }
+
+    // O(1), next values become current and the old current values are reused as the next buffer
+    void swap_buffers()
+    {
+        if(double_buffered_) { std::swap(dense_arr_, next_arr_); }
+    }
+
+    // batched lookups call prefetch_sparse() a few ids ahead and prefetch_dense() once the sparse slot is cached
+    void prefetch_sparse(entity_id id) { sparse_arr_.prefetch(id); }
+
+    void prefetch_dense(entity_id id)
+    {
+        size_t index = get_dense_index(id);
+        if(index != tombstone) { LAMECS_PREFETCH(dense_arr_.address(index)); }
+    }
+
+    void clear()
+    {
+        sparse_arr_.clear();
+        dense_arr_.clear();
+        next_arr_.clear();
+        dense_to_sparse_arr_.clear();
+        active_size_ = 0;
+    }
+    
+    bool contains(entity_id id) { return get_dense_index(id) != tombstone; }
+
+    bool empty() { return dense_arr_.size() == 0; }
+
+    size_t size() { return dense_arr_.size(); }
+
+    std::shared_ptr<sparse_set_interface> clone() { return std::make_shared<sparse_set>(*this); }
+
+    std::shared_ptr<sparse_set_interface> make_empty()
+    {
+        std::shared_ptr<sparse_set> pool = std::make_shared<sparse_set>();
+        if(double_buffered_) { pool->enable_double_buffering(); }
+        return pool;
+    }
+
+    // a whole pool of trivially copyable components goes over with one memcpy per dense page
+    // moved items keep their active or cold state and, when both pools are double buffered, their next value
+    void transfer(sparse_set_interface& target, std::span<const entity_id> from, std::span<const entity_id> to)
+    {
+        sparse_set& dst = static_cast<sparse_set&>(target);
+        size_t moved = 0;
+        for(entity_id id : from) { moved += contains(id); }
+
+        // the cold suffix of this pool can only follow dst items when dst has no cold suffix of its own
+        if(std::is_trivially_copyable_v<C> && moved == size() && dst.active_size_ == dst.size() && double_buffered_ == dst.double_buffered_)
+        {
+            size_t base = dst.size();
+            for(size_t page = 0; page < dense_arr_.page_count(); page++)
+            {
+                std::span<const C> items = dense_arr_.page_items(page);
+                dst.dense_arr_.append(items.data(), items.size());
+            }
+            for(size_t page = 0; page < next_arr_.page_count(); page++)
+            {
+                std::span<const C> items = next_arr_.page_items(page);
+                dst.next_arr_.append(items.data(), items.size());
+            }
+            dst.dense_to_sparse_arr_.resize(base + size());
+            for(size_t i = 0; i < from.size(); i++)
+            {
+                size_t index = get_dense_index(from[i]);
+                if(index == tombstone) { continue; }
+                dst.dense_to_sparse_arr_[base + index] = to[i];
+                dst.set_dense_index(to[i], base + index);
+            }
+            dst.active_size_ = base + active_size_;
+            clear();
+            return;
+        }
+
+        for(size_t i = 0; i < from.size() && moved > 0; i++)
+        {
+            size_t index = get_dense_index(from[i]);
+            if(index == tombstone) { continue; }
+            bool cold = index >= active_size_;
+            dst.push(to[i], std::move(dense_arr_[index]));
+            if(double_buffered_ && dst.double_buffered_) { dst.next(to[i]) = std::move(next_arr_[index]); }
+            if(cold) { dst.demote(to[i]); }
+            remove(from[i]);
+            moved--;
+        }
+    }
+
+    size_t active_size() { return active_size_; }
+
+    const std::vector<entity_id>& ids() { return dense_to_sparse_arr_; }
+
+    // dense items in pages of DENSE_SET_PAGE_SIZE, each page is contiguous and SIMD_ALIGNMENT aligned
+    size_t page_count() { return dense_arr_.page_count(); }
+
+    std::span<const C> page(size_t index) { return dense_arr_.page_items(index); }
+
+    std::tuple<std::span<C>> chunk(size_t offset, size_t count) { return dense_arr_.span(offset, count); }
+
+    // same as chunk() without copying a shared page
+    std::span<const C> read_chunk(size_t offset, size_t count) { return std::as_const(dense_arr_).span(offset, count); }
+};
+
+// components nearly every entity has, stored at their entity id without sparse indirection
+template <typename C>
+class direct_set : public sparse_set_interface
+{
+private:
+    aligned_vector<C> data_arr_;
+    std::vector<bool> present_arr_;
+    size_t size_ = 0;
+
+public:
+    using reference = C&;
+    using pointer   = C*;
+
+    C* set(entity_id id, C item)
+    {
+        if(id >= data_arr_.size())
+        {
+            data_arr_.resize(id + 1);
+            present_arr_.resize(id + 1, false);
+        }
+
+        if(!present_arr_[id]) { size_++; }
+        present_arr_[id] = true;
+        data_arr_[id] = std::move(item);
+        return &data_arr_[id];
+    }
+
+    void remove(entity_id id)
+    {
+        if(!contains(id)) { return; }
+        present_arr_[id] = false;
+        data_arr_[id] = C{};
+        size_--;
+    }
+
+    C& operator[](entity_id id)
+    {
+        LAMECS_ASSERT(!contains(id), "Direct set does not contain type " << typeid(C).name() << " for entity: " << id); 
+        return data_arr_[id];
+    }
+
+    C* try_get(entity_id id) { return contains(id) ? &data_arr_[id] : nullptr; }
+
+    void clear()
+    {
+        data_arr_.clear();
+        present_arr_.clear();
+        size_ = 0;
+    }
+
+    bool contains(entity_id id) { return id < present_arr_.size() && present_arr_[id]; }
+
+    void prefetch_dense(entity_id id)
+    {
+        if(id < data_arr_.size()) { LAMECS_PREFETCH(data_arr_.data() + id); }
+    }
+
+    bool empty() { return size_ == 0; }
+
+    size_t size() { return size_; }
+
+    std::shared_ptr<sparse_set_interface> clone() { return std::make_shared<direct_set>(*this); }
+
+    std::shared_ptr<sparse_set_interface> make_empty() { return std::make_shared<direct_set>(); }
+
+    void transfer(sparse_set_interface& target, std::span<const entity_id> from, std::span<const entity_id> to)
+    {
+        direct_set& dst = static_cast<direct_set&>(target);
+        for(size_t i = 0; i < from.size(); i++)
+            if(contains(from[i])) { dst.set(to[i], std::move(data_arr_[from[i]])); remove(from[i]); }
+    }
+};
+
+// components that must not move in memory once added, slots are stored in fixed size pages and reused after removal
+template <typename C>
+class paged_set : public sparse_set_interface
+{
+private:
+    std::vector<std::vector<C>> pages_;
+    std::vector<entity_id> slot_owners_;
+    std::vector<size_t> free_slots_;
+    sparse_index sparse_arr_;
+    size_t size_ = 0;
+
+    C& slot(size_t index) { return pages_[index / PAGED_SET_PAGE_SIZE][index % PAGED_SET_PAGE_SIZE]; }
+
+public:
+    using reference = C&;
+    using pointer   = C*;
+
+    paged_set() = default;
+
+    // copied pages only get their size as capacity, reserve them again so elements of the copy keep their address too
+    paged_set(const paged_set& other)
+        : pages_(other.pages_), slot_owners_(other.slot_owners_), free_slots_(other.free_slots_), sparse_arr_(other.sparse_arr_), size_(other.size_)
+    {
+        for(std::vector<C>& page : pages_) { page.reserve(PAGED_SET_PAGE_SIZE); }
+    }
+
+    C* set(entity_id id, C item)
+    {
+        size_t index = sparse_arr_.get(id);
+
+        if(index != tombstone)
+        {
+            slot(index) = std::move(item);
+            return &slot(index);
+        }
+
+        if(!free_slots_.empty())
+        {
+            index = free_slots_.back();
+            free_slots_.pop_back();
+            slot(index) = std::move(item);
+            slot_owners_[index] = id;
+        }
+        else
+        {
+            if(pages_.empty() || pages_.back().size() == PAGED_SET_PAGE_SIZE)
+            {
+                pages_.emplace_back();
+                pages_.back().reserve(PAGED_SET_PAGE_SIZE); // never grows past this, so elements keep their address
+            }
+
+            index = slot_owners_.size();
+            pages_.back().push_back(std::move(item));
+            slot_owners_.push_back(id);
+        }
+
+        sparse_arr_.set(id, index);
+        size_++;
+        return &slot(index);
+    }
+
+    void remove(entity_id id)
+    {
+        size_t index = sparse_arr_.get(id);
+        if(index == tombstone) { return; }
+
+        slot(index) = C{}; // releases whatever the component owns now, the slot keeps its address for the next set()
+        sparse_arr_.set(id, tombstone);
+        slot_owners_[index] = null_entity;
+        free_slots_.push_back(index);
+        size_--;
+    }
+
+    C& operator[](entity_id id)
+    {
+        size_t index = sparse_arr_.get(id);
+        LAMECS_ASSERT(index == tombstone, "Paged set does not contain type " << typeid(C).name() << " for entity: " << id); 
+        return slot(index);
+    }
+
+    C* try_get(entity_id id)
+    {
+        size_t index = sparse_arr_.get(id);
+        return index == tombstone ? nullptr : &slot(index);
+    }
+
+    void clear()
+    {
+        pages_.clear();
+        slot_owners_.clear();
+        free_slots_.clear();
+        sparse_arr_.clear();
+        size_ = 0;
+    }
+
+    bool contains(entity_id id) { return sparse_arr_.get(id) != tombstone; }
+
+    bool empty() { return size_ == 0; }
+
+    size_t size() { return size_; }
+
+    std::shared_ptr<sparse_set_interface> clone() { return std::make_shared<paged_set>(*this); }
+
+    std::shared_ptr<sparse_set_interface> make_empty() { return std::make_shared<paged_set>(); }
+
+    void transfer(sparse_set_interface& target, std::span<const entity_id> from, std::span<const entity_id> to)
+    {
+        paged_set& dst = static_cast<paged_set&>(target);
+        for(size_t i = 0; i < from.size(); i++)
+        {
+            size_t index = sparse_arr_.get(from[i]);
+            if(index != tombstone) { dst.set(to[i], std::move(slot(index))); remove(from[i]); }
+        }
+    }
+};
+
+// empty components, only membership is stored
+template <typename C>
+class tag_set : public sparse_set_interface
+{
+    static_assert(std::is_empty_v<C>, "tag_set can only store empty types");
+
+private:
+    inline static C instance_{};
+    std::vector<entity_id> dense_arr_;
+    sparse_index sparse_arr_;
+
+public:
+    using reference = C&;
+    using pointer   = C*;
+
+    C* set(entity_id id, C)
+    {
+        if(!contains(id))
+        {
+            sparse_arr_.set(id, dense_arr_.size());
+            dense_arr_.push_back(id);
+        }
+        return &instance_;
+    }
+
+    void remove(entity_id id)
+    {
+        size_t index = sparse_arr_.get(id);
+        if(index == tombstone) { return; }
+
+        sparse_arr_.set(dense_arr_.back(), index);
+        sparse_arr_.set(id, tombstone);
+        dense_arr_[index] = dense_arr_.back();
+        dense_arr_.pop_back();
+    }
+
+    C& operator[](entity_id id)
+    {
+        LAMECS_ASSERT(!contains(id), "Tag set does not contain type " << typeid(C).name() << " for entity: " << id); 
+        return instance_;
+    }
+
+    C* try_get(entity_id id) { return contains(id) ? &instance_ : nullptr; }
+
+    void clear()
+    {
+        dense_arr_.clear();
+        sparse_arr_.clear();
+    }
+
+    bool contains(entity_id id) { return sparse_arr_.get(id) != tombstone; }
+
+    bool empty() { return dense_arr_.empty(); }
+
+    size_t size() { return dense_arr_.size(); }
+
+    std::shared_ptr<sparse_set_interface> clone() { return std::make_shared<tag_set>(*this); }
+
+    std::shared_ptr<sparse_set_interface> make_empty() { return std::make_shared<tag_set>(); }
+
+    void transfer(sparse_set_interface& target, std::span<const entity_id> from, std::span<const entity_id> to)
+    {
+        tag_set& dst = static_cast<tag_set&>(target);
+        for(size_t i = 0; i < from.size(); i++)
+            if(contains(from[i])) { dst.set(to[i], C{}); remove(from[i]); }
+    }
+
+    const std::vector<entity_id>& ids() { return dense_arr_; }
+};
+
+// empty flag components, one bit per entity id
+template <typename C>
+class bitmap_set : public sparse_set_interface
+{
+    static_assert(std::is_empty_v<C>, "bitmap_set can only store empty types");
+
+private:
+    inline static C instance_{};
+    std::vector<uint64_t> words_;
+    size_t size_ = 0;
+
+public:
+    using reference = C&;
+    using pointer   = C*;
+
+    C* set(entity_id id, C)
+    {
+        size_t word = id / 64;
+        if(word >= words_.size()) { words_.resize(word + 1, 0); }
+        if(!contains(id)) { size_++; }
+        words_[word] |= uint64_t(1) << (id % 64);
+        return &instance_;
+    }
+
+    void remove(entity_id id)
+    {
+        if(!contains(id)) { return; }
+        words_[id / 64] &= ~(uint64_t(1) << (id % 64));
+        size_--;
+    }
+
+    C& operator[](entity_id id)
+    {
+        LAMECS_ASSERT(!contains(id), "Bitmap set does not contain type " << typeid(C).name() << " for entity: " << id); 
+        return instance_;
+    }
+
+    C* try_get(entity_id id) { return contains(id) ? &instance_ : nullptr; }
+
+    void clear()
+    {
+        words_.clear();
+        size_ = 0;
+    }
+
+    bool contains(entity_id id) { return id / 64 < words_.size() && (words_[id / 64] >> (id % 64)) & 1; }
+
+    bool empty() { return size_ == 0; }
+
+    size_t size() { return size_; }
+
+    std::shared_ptr<sparse_set_interface> clone() { return std::make_shared<bitmap_set>(*this); }
+
+    std::shared_ptr<sparse_set_interface> make_empty() { return std::make_shared<bitmap_set>(); }
+
+    void transfer(sparse_set_interface& target, std::span<const entity_id> from, std::span<const entity_id> to)
+    {
+        bitmap_set& dst = static_cast<bitmap_set&>(target);
+        for(size_t i = 0; i < from.size(); i++)
+            if(contains(from[i])) { dst.set(to[i], C{}); remove(from[i]); }
+    }
+};
+
+// declares the fields of a component stored as structure of arrays, use LAMECS_SOA_COMPONENT to specialise it
+template <typename C>
+struct soa_fields;
+
+template <typename M>
+struct member_traits;
+
+template <typename C, typename F>
+struct member_traits<F C::*> { using type = F; };
+
+template <typename C>
+using soa_members_t = std::remove_const_t<decltype(soa_fields<C>::members)>;
+
+template <typename Members>
+struct soa_layout;
+
+template <typename... Ms>
+struct soa_layout<std::tuple<Ms...>>
+{
+    using columns  = std::tuple<aligned_vector<typename member_traits<Ms>::type>...>;
+    using pointers = std::tuple<typename member_traits<Ms>::type*...>;
+    using spans    = std::tuple<std::span<typename member_traits<Ms>::type>...>;
+};
+
+// proxy reference to a component scattered across soa_set columns, converts to and from C and supports structured bindings
+template <typename C>
+class soa_ref
+{
+private:
+    using pointers = typename soa_layout<soa_members_t<C>>::pointers;
+    pointers fields_;
+
+    template<size_t... Is>
+    void load(C& item, std::index_sequence<Is...>) const { ((item.*std::get<Is>(soa_fields<C>::members) = *std::get<Is>(fields_)), ...); }
+
+    template<size_t... Is>
+    void store(const C& item, std::index_sequence<Is...>) const { ((*std::get<Is>(fields_) = item.*std::get<Is>(soa_fields<C>::members)), ...); }
+
+public:
+    static constexpr size_t field_count = std::tuple_size_v<soa_members_t<C>>;
+
+    explicit soa_ref(pointers fields) : fields_(fields) {}
+
+    template<size_t I>
+    auto& get() const { return *std::get<I>(fields_); }
+
+    operator C() const
+    {
+        C item{};
+        load(item, std::make_index_sequence<field_count>{});
+        return item;
+    }
+
+    const soa_ref& operator=(const C& item) const
+    {
+        store(item, std::make_index_sequence<field_count>{});
+        return *this;
+    }
+};
+
+// opt-in structure of arrays pool, every declared field of C lives in its own dense array
+template <typename C>
+class soa_set : public sparse_set_interface
+{
+private:
+    using layout = soa_layout<soa_members_t<C>>;
+    static constexpr size_t field_count = std::tuple_size_v<soa_members_t<C>>;
+
+    std::vector<entity_id> dense_to_sparse_arr_;
+    typename layout::columns columns_;
+    sparse_index sparse_arr_;
+
+    template<size_t... Is>
+    void store(size_t index, const C& item, std::index_sequence<Is...>) { ((std::get<Is>(columns_)[index] = item.*std::get<Is>(soa_fields<C>::members)), ...); }
+
+    template<size_t... Is>
+    void push_fields(const C& item, std::index_sequence<Is...>) { (std::get<Is>(columns_).push_back(item.*std::get<Is>(soa_fields<C>::members)), ...); }
+
+    template<size_t... Is>
+    void swap_and_pop(size_t index, std::index_sequence<Is...>)
+    {
+        (std::get<Is>(columns_).swap_and_pop(index), ...);
+    }
+
+    template<size_t... Is>
+    C load(size_t index, std::index_sequence<Is...>)
+    {
+        C item{};
+        ((item.*std::get<Is>(soa_fields<C>::members) = std::get<Is>(columns_)[index]), ...);
+        return item;
+    }
+
+    template<size_t... Is>
+    soa_ref<C> make_ref(size_t index, std::index_sequence<Is...>) { return soa_ref<C>({&std::get<Is>(columns_)[index]...}); }
+
+    template<size_t... Is>
+    typename layout::spans make_spans(size_t offset, size_t count, std::index_sequence<Is...>)
+    {
+        return typename layout::spans(std::span(std::get<Is>(columns_).data() + offset, count)...);
+    }
+
+public:
+    using reference = soa_ref<C>;
+    using pointer   = std::optional<soa_ref<C>>; // there is no C object to point at
+
+    soa_ref<C> set(entity_id id, C item)
+    {
+        size_t index = sparse_arr_.get(id);
+
+        if(index == tombstone)
+        {
+            index = dense_to_sparse_arr_.size();
+            sparse_arr_.set(id, index);
+            dense_to_sparse_arr_.push_back(id);
+            push_fields(item, std::make_index_sequence<field_count>{});
+        }
+        else
+        {
+            store(index, item, std::make_index_sequence<field_count>{});
+        }
+
+        return make_ref(index, std::make_index_sequence<field_count>{});
+    }
+
+    void remove(entity_id id)
+    {
+        size_t index = sparse_arr_.get(id);
+        if(index == tombstone) { return; }
+
+        sparse_arr_.set(dense_to_sparse_arr_.back(), index);
+        sparse_arr_.set(id, tombstone);
+        dense_to_sparse_arr_[index] = dense_to_sparse_arr_.back();
+        dense_to_sparse_arr_.pop_back();
+        swap_and_pop(index, std::make_index_sequence<field_count>{});
+    }
+
+    soa_ref<C> operator[](entity_id id)
+    {
+        size_t index = sparse_arr_.get(id);
+        LAMECS_ASSERT(index == tombstone, "Soa set does not contain type " << typeid(C).name() << " for entity: " << id); 
+        return make_ref(index, std::make_index_sequence<field_count>{});
+    }
+
+    std::optional<soa_ref<C>> try_get(entity_id id)
+    {
+        size_t index = sparse_arr_.get(id);
+        if(index == tombstone) { return std::nullopt; }
+        return make_ref(index, std::make_index_sequence<field_count>{});
+    }
+
+    void clear()
+    {
+        dense_to_sparse_arr_.clear();
+        std::apply([](auto&... column) { (column.clear(), ...); }, columns_);
+        sparse_arr_.clear();
+    }
+
+    bool contains(entity_id id) { return sparse_arr_.get(id) != tombstone; }
+
+    bool empty() { return dense_to_sparse_arr_.empty(); }
+
+    size_t size() { return dense_to_sparse_arr_.size(); }
+
+    std::shared_ptr<sparse_set_interface> clone() { return std::make_shared<soa_set>(*this); }
+
+    std::shared_ptr<sparse_set_interface> make_empty() { return std::make_shared<soa_set>(); }
+
+    void transfer(sparse_set_interface& target, std::span<const entity_id> from, std::span<const entity_id> to)
+    {
+        soa_set& dst = static_cast<soa_set&>(target);
+        for(size_t i = 0; i < from.size(); i++)
+        {
+            size_t index = sparse_arr_.get(from[i]);
+            if(index != tombstone) { dst.set(to[i], load(index, std::make_index_sequence<field_count>{})); remove(from[i]); }
+        }
+    }
+
+    const std::vector<entity_id>& ids() { return dense_to_sparse_arr_; }
+
+    template<size_t I>
+    auto field() { return std::span(std::get<I>(columns_).data(), std::get<I>(columns_).size()); }
+
+    // per field spans of [offset, offset + count) in dense order
+    typename layout::spans chunk(size_t offset, size_t count) { return make_spans(offset, count, std::make_index_sequence<field_count>{}); }
+};
+
+// flyweight pool, equal values are interned once and entities only hold a handle to them
+// C needs operator== and a std::hash specialisation, components are read only and changed by emplacing a new value
+template <typename C>
+class shared_set : public sparse_set_interface
+{
+private:
+    struct shared_value
+    {
+        const C* value = nullptr;      // points at the key inside interned_
+        std::vector<entity_id> ids;    // entities sharing the value, the refcount is ids.size()
+    };
+
+    std::unordered_map<C, uint32_t> interned_;
+    std::vector<shared_value> values_;
+    std::vector<uint32_t> free_handles_;
+
+    std::vector<entity_id> dense_to_sparse_arr_;
+    std::vector<uint32_t> handles_; // dense, handle of each entity
+    std::vector<size_t> slots_;     // dense, position of each entity in values_[handle].ids
+    sparse_index sparse_arr_;
+
+    uint32_t acquire(C&& item)
+    {
+        auto it = interned_.find(item);
+        if(it != interned_.end()) { return it->second; }
+
+        uint32_t handle;
+        if(!free_handles_.empty()) { handle = free_handles_.back(); free_handles_.pop_back(); }
+        else { handle = static_cast<uint32_t>(values_.size()); values_.emplace_back(); }
+
+        it = interned_.emplace(std::move(item), handle).first;
+        values_[handle].value = &it->first;
+        return handle;
+    }
+
+    void release(size_t index)
+    {
+        shared_value& shared = values_[handles_[index]];
+        size_t slot = slots_[index];
+
+        slots_[sparse_arr_.get(shared.ids.back())] = slot;
+        shared.ids[slot] = shared.ids.back();
+        shared.ids.pop_back();
+
+        if(shared.ids.empty())
+        {
+            interned_.erase(*shared.value);
+            shared.value = nullptr;
+            free_handles_.push_back(handles_[index]);
+        }
+    }
+
+    void attach(size_t index, uint32_t handle)
+    {
+        handles_[index] = handle;
+        slots_[index] = values_[handle].ids.size();
+        values_[handle].ids.push_back(dense_to_sparse_arr_[index]);
+    }
+
+public:
+    using reference = const C&;
+    using pointer   = const C*;
+
+    shared_set() = default;
+
+    // values_ points into the keys of interned_, so a copy has to point into its own map
+    shared_set(const shared_set& other)
+        : interned_(other.interned_), values_(other.values_), free_handles_(other.free_handles_), dense_to_sparse_arr_(other.dense_to_sparse_arr_),
+          handles_(other.handles_), slots_(other.slots_), sparse_arr_(other.sparse_arr_)
+    {
+        for(auto& [value, handle] : interned_) { values_[handle].value = &value; }
+    }
+
+    const C* set(entity_id id, C item)
+    {
+        size_t index = sparse_arr_.get(id);
+        uint32_t handle = acquire(std::move(item));
+
+        if(index == tombstone)
+        {
+            index = dense_to_sparse_arr_.size();
+            sparse_arr_.set(id, index);
+            dense_to_sparse_arr_.push_back(id);
+            handles_.push_back(0);
+            slots_.push_back(0);
+        }
+        else
+        {
+            if(handles_[index] == handle) { return values_[handle].value; }
+            release(index);
+        }
+
+        attach(index, handle);
+        return values_[handle].value;
+    }
+
+    void remove(entity_id id)
+    {
+        size_t index = sparse_arr_.get(id);
+        if(index == tombstone) { return; }
+
+        release(index);
+
+        size_t last = dense_to_sparse_arr_.size() - 1;
+        if(index != last)
+        {
+            dense_to_sparse_arr_[index] = dense_to_sparse_arr_[last];
+            handles_[index] = handles_[last];
+            slots_[index] = slots_[last];
+            sparse_arr_.set(dense_to_sparse_arr_[index], index);
+        }
+        sparse_arr_.set(id, tombstone);
+        dense_to_sparse_arr_.pop_back();
+        handles_.pop_back();
+        slots_.pop_back();
+    }
+
+    const C& operator[](entity_id id)
+    {
+        size_t index = sparse_arr_.get(id);
+        LAMECS_ASSERT(index == tombstone, "Shared set does not contain type " << typeid(C).name() << " for entity: " << id); 
+        return *values_[handles_[index]].value;
+    }
+
+    const C* try_get(entity_id id)
+    {
+        size_t index = sparse_arr_.get(id);
+        return index == tombstone ? nullptr : values_[handles_[index]].value;
+    }
+
+    void clear()
+    {
+        interned_.clear();
+        values_.clear();
+        free_handles_.clear();
+        dense_to_sparse_arr_.clear();
+        handles_.clear();
+        slots_.clear();
+        sparse_arr_.clear();
+    }
+
+    bool contains(entity_id id) { return sparse_arr_.get(id) != tombstone; }
+
+    bool empty() { return dense_to_sparse_arr_.empty(); }
+
+    size_t size() { return dense_to_sparse_arr_.size(); }
+
+    std::shared_ptr<sparse_set_interface> clone() { return std::make_shared<shared_set>(*this); }
+
+    std::shared_ptr<sparse_set_interface> make_empty() { return std::make_shared<shared_set>(); }
+
+    // values are interned again on the target side, equal values still end up shared there
+    void transfer(sparse_set_interface& target, std::span<const entity_id> from, std::span<const entity_id> to)
+    {
+        shared_set& dst = static_cast<shared_set&>(target);
+        for(size_t i = 0; i < from.size(); i++)
+            if(contains(from[i])) { dst.set(to[i], (*this)[from[i]]); remove(from[i]); }
+    }
+
+    // number of distinct values currently stored
+    size_t unique_size() { return interned_.size(); }
+
+    const std::vector<entity_id>& ids() { return dense_to_sparse_arr_; }
+
+    // [](const C& value, std::span<const entity_id> ids), once per distinct value
+    template<typename Func>
+    void each_shared(Func&& func)
+    {
+        for(shared_value& shared : values_)
+            if(shared.value != nullptr) { func(*shared.value, std::span<const entity_id>(shared.ids)); }
+    }
+};
+
+#ifdef LAMECS_SHM
+// start of a shm_set segment, arrays are found through offsets because every process maps the segment at its own address
+struct shm_header
+{
+    std::atomic<uint64_t> sequence;     // seqlock, odd while the writer is changing the pool
+    std::atomic<uint64_t> mapped_bytes; // readers remap when this grows
+    std::atomic<uint64_t> capacity;
+    std::atomic<uint64_t> size;
+    std::atomic<uint64_t> ids_offset;
+    std::atomic<uint64_t> data_offset;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shm_header needs address free atomics");
+
+// pool whose dense ids and components can live in a POSIX shared memory segment, other processes read them zero copy with shm_reader<C>
+// pools start private, registry::publish<C>(name) moves one into a segment named by the caller, so every registry picks its own name
+// set()/remove() are seqlocked on their own, writes through references are only seen as one change inside registry::write_scope()
+// a segment name has one writer, a second shm_set on a live name aborts, copies made by .fork(), .snapshot_view() or .move_to() stay private
+template <typename C>
+class shm_set : public sparse_set_interface
+{
+    static_assert(std::is_trivially_copyable_v<C>, "shm_set can only store trivially copyable types");
+
+private:
+    std::string name_; // empty for private copies
+    int fd_ = -1;
+    std::byte* base_ = nullptr;
+    size_t write_depth_ = 0;
+    sparse_index sparse_arr_;
+
+    static size_t align_up(size_t value) { return (value + SIMD_ALIGNMENT - 1) / SIMD_ALIGNMENT * SIMD_ALIGNMENT; }
+
+    shm_header& header() { return *reinterpret_cast<shm_header*>(base_); }
+    entity_id* id_arr() { return reinterpret_cast<entity_id*>(base_ + header().ids_offset.load(std::memory_order_relaxed)); }
+    C* data_arr() { return reinterpret_cast<C*>(base_ + header().data_offset.load(std::memory_order_relaxed)); }
+
+    std::byte* map(size_t bytes)
+    {
+        if(fd_ >= 0) { LAMECS_ASSERT(ftruncate(fd_, bytes) != 0, "Cant resize shared memory segment " << name_); }
+        void* memory = fd_ >= 0 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0)
+                                : mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        LAMECS_ASSERT(memory == MAP_FAILED, "Cant map shared memory segment " << name_);
+        return static_cast<std::byte*>(memory);
+    }
+
+    // remaps for capacity items, ids keep their offset and the components are shifted behind them
+    // a named segment only grows so readers can keep their old mapping until they notice
+    void grow(size_t capacity)
+    {
+        size_t ids_offset  = align_up(sizeof(shm_header));
+        size_t data_offset = align_up(ids_offset + capacity * sizeof(entity_id));
+        size_t bytes       = data_offset + capacity * sizeof(C);
+        std::byte* base    = map(bytes);
+
+        if(base_ == nullptr) { new (base) shm_header{}; }
+        else
+        {
+            size_t old_bytes = header().mapped_bytes.load(std::memory_order_relaxed);
+            if(fd_ < 0) { std::memcpy(base, base_, old_bytes); }
+            std::memmove(base + data_offset, base + header().data_offset.load(std::memory_order_relaxed), header().size.load(std::memory_order_relaxed) * sizeof(C));
+            munmap(base_, old_bytes);
+        }
+
+        base_ = base;
+        header().ids_offset.store(ids_offset, std::memory_order_relaxed);
+        header().data_offset.store(data_offset, std::memory_order_relaxed);
+        header().capacity.store(capacity, std::memory_order_relaxed);
+        header().mapped_bytes.store(bytes, std::memory_order_relaxed);
+    }
+
+public:
+    using reference = C&;
+    using pointer   = C*;
+
+    shm_set() : shm_set(std::string()) {}
+
+    // an empty name keeps the pool in private memory
+    explicit shm_set(std::string name) : name_(std::move(name))
+    {
+        if(!name_.empty())
+        {
+            fd_ = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+            LAMECS_ASSERT(fd_ < 0 && errno == EEXIST, "Shared memory segment " << name_ << " already has a writer, pick another name through shm_segment<C> or shm_unlink() one left behind by a crash");
+            LAMECS_ASSERT(fd_ < 0, "Cant create shared memory segment " << name_);
+        }
+        grow(SHM_SET_MIN_CAPACITY);
+    }
+
+    // copies are private, a second writer on the same segment would corrupt it
+    shm_set(const shm_set& other) : shm_set(std::string(), const_cast<shm_set&>(other)) {}
+
+    // copy of source in the segment name, what registry::publish<C>() swaps in
+    shm_set(std::string name, shm_set& source) : shm_set(std::move(name))
+    {
+        sparse_arr_ = source.sparse_arr_;
+        if(source.capacity() > capacity()) { grow(source.capacity()); }
+        std::memcpy(id_arr(), source.id_arr(), source.size() * sizeof(entity_id));
+        std::memcpy(static_cast<void*>(data_arr()), source.data_arr(), source.size() * sizeof(C));
+        header().size.store(source.size(), std::memory_order_relaxed);
+    }
+
+    shm_set& operator=(const shm_set&) = delete;
+
+    ~shm_set()
+    {
+        munmap(base_, header().mapped_bytes.load(std::memory_order_relaxed));
+        if(fd_ < 0) { return; }
+        close(fd_);
+        shm_unlink(name_.c_str());
+    }
+
+    // nests, readers retry while the outermost write is open
+    void begin_write()
+    {
+        if(write_depth_++ > 0) { return; }
+        header().sequence.store(header().sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void end_write()
+    {
+        if(--write_depth_ > 0) { return; }
+        header().sequence.fetch_add(1, std::memory_order_release);
+    }
+
+    C* set(entity_id id, C item)
+    {
+        begin_write();
+        size_t index = sparse_arr_.get(id);
+
+        if(index == tombstone)
+        {
+            index = size();
+            if(index == capacity()) { grow(index * 2); }
+            sparse_arr_.set(id, index);
+            id_arr()[index] = id;
+            header().size.store(index + 1, std::memory_order_relaxed);
+        }
+
+        data_arr()[index] = item;
+        end_write();
+        return &data_arr()[index];
+    }
+
+    void remove(entity_id id)
+    {
+        size_t index = sparse_arr_.get(id);
+        if(index == tombstone) { return; }
+
+        begin_write();
+        size_t last = size() - 1;
+        id_arr()[index] = id_arr()[last];
+        data_arr()[index] = data_arr()[last];
+        sparse_arr_.set(id_arr()[index], index);
+        sparse_arr_.set(id, tombstone);
+        header().size.store(last, std::memory_order_relaxed);
+        end_write();
+    }
+
+    C& operator[](entity_id id)
+    {
+        size_t index = sparse_arr_.get(id);
+        LAMECS_ASSERT(index == tombstone, "Shm set does not contain type " << typeid(C).name() << " for entity: " << id); 
+        return data_arr()[index];
+    }
+
+    C* try_get(entity_id id)
+    {
+        size_t index = sparse_arr_.get(id);
+        return index == tombstone ? nullptr : &data_arr()[index];
+    }
+
+    void clear()
+    {
+        begin_write();
+        header().size.store(0, std::memory_order_relaxed);
+        sparse_arr_.clear();
+        end_write();
+    }
+
+    bool contains(entity_id id) { return sparse_arr_.get(id) != tombstone; }
+
+    void prefetch_sparse(entity_id id) { sparse_arr_.prefetch(id); }
+
+    void prefetch_dense(entity_id id)
+    {
+        size_t index = sparse_arr_.get(id);
+        if(index != tombstone) { LAMECS_PREFETCH(data_arr() + index); }
+    }
+
+    bool empty() { return size() == 0; }
+
+    size_t size() { return header().size.load(std::memory_order_relaxed); }
+
+    size_t capacity() { return header().capacity.load(std::memory_order_relaxed); }
+
+    bool process_shared() { return !name_.empty(); }
+
+    std::shared_ptr<sparse_set_interface> clone() { return std::make_shared<shm_set>(*this); }
+
+    std::shared_ptr<sparse_set_interface> make_empty() { return std::make_shared<shm_set>(std::string()); }
+
+    void transfer(sparse_set_interface& target, std::span<const entity_id> from, std::span<const entity_id> to)
+    {
+        shm_set& dst = static_cast<shm_set&>(target);
+        for(size_t i = 0; i < from.size(); i++)
+            if(contains(from[i])) { dst.set(to[i], (*this)[from[i]]); remove(from[i]); }
+    }
+
+    std::span<const entity_id> ids() { return std::span<const entity_id>(id_arr(), size()); }
+};
+
+// read only mapping of a shm_set<C> published by another process
+template <typename C>
+class shm_reader
+{
+private:
+    std::string name_;
+    int fd_ = -1;
+    const std::byte* base_ = nullptr;
+    size_t mapped_bytes_ = 0;
+
+    const shm_header& header() { return *reinterpret_cast<const shm_header*>(base_); }
+
+    void unmap()
+    {
+        if(base_ != nullptr) { munmap(const_cast<std::byte*>(base_), mapped_bytes_); }
+        base_ = nullptr;
+        mapped_bytes_ = 0;
+    }
+
+    bool map(size_t bytes)
+    {
+        unmap();
+        void* memory = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd_, 0);
+        if(memory == MAP_FAILED) { return false; }
+        base_ = static_cast<const std::byte*>(memory);
+        mapped_bytes_ = bytes;
+        return true;
+    }
+
+    // the writer may not have created the segment yet, so opening is retried by every read
+    bool open()
+    {
+        if(fd_ < 0) { fd_ = shm_open(name_.c_str(), O_RDONLY, 0); }
+        if(fd_ < 0) { return false; }
+
+        struct stat info;
+        if(base_ == nullptr && (fstat(fd_, &info) != 0 || size_t(info.st_size) < sizeof(shm_header) || !map(sizeof(shm_header)))) { return false; }
+
+        size_t bytes = header().mapped_bytes.load(std::memory_order_acquire);
+        return bytes == mapped_bytes_ || map(bytes);
+    }
+
+public:
+    // name is the one the writing registry passed to .publish<C>()
+    explicit shm_reader(std::string name) : name_(std::move(name)) { open(); }
+
+    shm_reader(const shm_reader&) = delete;
+    shm_reader& operator=(const shm_reader&) = delete;
+
+    ~shm_reader()
+    {
+        unmap();
+        if(fd_ >= 0) { close(fd_); }
+    }
+
+    // changes every time the writer changes the pool
+    uint64_t sequence() { return open() ? header().sequence.load(std::memory_order_acquire) : 0; }
+
+    // func(std::span<const entity_id> ids, std::span<const C> components) runs on the segment in place
+    // returns false when the writer was active meanwhile, anything func derived from the data must then be thrown away
+    template<typename Func>
+    bool try_read(Func&& func)
+    {
+        if(!open()) { return false; }
+
+        uint64_t before = header().sequence.load(std::memory_order_acquire);
+        if(before & 1) { return false; }
+
+        size_t size        = header().size.load(std::memory_order_relaxed);
+        size_t ids_offset  = header().ids_offset.load(std::memory_order_relaxed);
+        size_t data_offset = header().data_offset.load(std::memory_order_relaxed);
+        if(data_offset + size * sizeof(C) > mapped_bytes_ || ids_offset + size * sizeof(entity_id) > data_offset) { return false; }
+
+        func(std::span<const entity_id>(reinterpret_cast<const entity_id*>(base_ + ids_offset), size),
+             std::span<const C>(reinterpret_cast<const C*>(base_ + data_offset), size));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return header().sequence.load(std::memory_order_relaxed) == before;
+    }
+
+    // copies the pool out, retrying until the copy is consistent, false if there is no segment to read
+    bool snapshot(std::vector<entity_id>& ids, std::vector<C>& components)
+    {
+        if(!open()) { return false; }
+
+        auto copy = [&](std::span<const entity_id> id_span, std::span<const C> component_span)
+        {
+            ids.assign(id_span.begin(), id_span.end());
+            components.assign(component_span.begin(), component_span.end());
+        };
+
+        while(!try_read(copy)) { std::this_thread::yield(); }
+        return true;
+    }
+};
+#endif
+
+// customisation point to pick the pool of a component type, e.g.
+// template<> struct lamecs::storage_traits<health> { using storage_type = lamecs::direct_set<health>; };
+template <typename C>
+struct storage_traits
+{
+    using storage_type = sparse_set<C>;
+};
+
+template <typename C>
+using storage_t = typename storage_traits<C>::storage_type;
+
+template <typename C>
+using component_ref_t = typename storage_t<C>::reference;
+
+template <typename C>
+using component_ptr_t = typename storage_t<C>::pointer;
+
+// components are read as const references, soa pools keep their proxy
+template <typename C>
+using component_cref_t = std::conditional_t<std::is_reference_v<component_ref_t<C>>, const std::remove_reference_t<component_ref_t<C>>&, component_ref_t<C>>;
+
+// read access that leaves pages shared with a fork or snapshot alone, sparse sets copy a shared page on operator[]
+template <typename C>
+component_cref_t<C> read_component(storage_t<C>& pool, entity_id id)
+{
+    if constexpr(requires { pool.read(id); }) return pool.read(id);
+    else return pool[id];
+}
+
+template <typename C>
+auto try_read_component(storage_t<C>& pool, entity_id id)
+{
+    if constexpr(requires { pool.try_read(id); }) return pool.try_read(id);
+    else return pool.try_get(id);
+}
+
+// stores C in a soa_set, fields are given as member pointers: LAMECS_SOA_COMPONENT(pos, &pos::x, &pos::y, &pos::z)
+#define LAMECS_SOA_COMPONENT(C, ...) \
+    template<> struct lamecs::soa_fields<C> { static constexpr auto members = std::make_tuple(__VA_ARGS__); }; \
+    template<> struct lamecs::storage_traits<C> { using storage_type = lamecs::soa_set<C>; };
+
+struct hierarchy_node
+{
+    entity_id parent   = null_entity;
+    size_t depth       = 0;
+    size_t first_child = 0; // children live in order_[first_child, first_child + child_count)
+    size_t child_count = 0;
+};
+
+// parent/child links kept in a breadth first order, parents always come before their children and siblings are contiguous
+// the order is rebuilt lazily after structural changes so walking it stays a single linear pass
+class hierarchy
+{
+private:
+    sparse_set<hierarchy_node> nodes_;
+    std::vector<entity_id> order_;
+    bool dirty_ = false;
+
+    hierarchy_node& node(entity_id id)
+    {
+        if(!nodes_.contains(id)) { nodes_.push(id, hierarchy_node()); }
+        return nodes_[id];
+    }
+
+    void rebuild()
+    {
+        if(!dirty_) { return; }
+        dirty_ = false;
+        order_.clear();
+
+        // (parent, child) pairs sorted by parent so every parent's children form one range
+        std::vector<std::pair<entity_id, entity_id>> links;
+        for(entity_id id : nodes_.ids())
+        {
+            hierarchy_node& n = nodes_[id];
+            n.child_count = 0;
+            if(n.parent == null_entity) { order_.push_back(id); n.depth = 0; }
+            else { links.emplace_back(n.parent, id); }
+        }
+        std::sort(links.begin(), links.end());
+
+        for(size_t i = 0; i < order_.size(); i++)
+        {
+            hierarchy_node& n = nodes_[order_[i]];
+            auto first = std::lower_bound(links.begin(), links.end(), std::make_pair(order_[i], entity_id(0)));
+            n.first_child = order_.size();
+
+            for(auto it = first; it != links.end() && it->first == order_[i]; it++)
+            {
+                nodes_[it->second].depth = n.depth + 1;
+                order_.push_back(it->second);
+                n.child_count++;
+            }
+        }
+    }
+
+public:
+    bool contains(entity_id id) { return nodes_.contains(id); }
+
+    void set_parent(entity_id child, entity_id parent)
+    {
+        for(entity_id it = parent; it != null_entity; it = nodes_.contains(it) ? nodes_[it].parent : null_entity)
+        {
+            if(it == child)
+            {
+                LAMECS_INFO("Entity: " << parent << " is a descendant of " << child << ", cant set it as parent");
+                return;
+            }
+        }
+
+        if(parent != null_entity) { node(parent); }
+        node(child).parent = parent;
+        dirty_ = true;
+    }
+
+    entity_id parent(entity_id id) { return nodes_.contains(id) ? nodes_[id].parent : null_entity; }
+
+    size_t depth(entity_id id)
+    {
+        rebuild();
+        return nodes_.contains(id) ? nodes_[id].depth : 0;
+    }
+
+    std::span<const entity_id> children(entity_id id)
+    {
+        rebuild();
+        if(!nodes_.contains(id)) { return {}; }
+        hierarchy_node& n = nodes_[id];
+        return std::span<const entity_id>(order_.data() + n.first_child, n.child_count);
+    }
+
+    // id followed by all of its descendants, parents first
+    std::vector<entity_id> subtree(entity_id id)
+    {
+        std::vector<entity_id> result = { id };
+        for(size_t i = 0; i < result.size(); i++)
+            for(entity_id child : children(result[i])) { result.push_back(child); }
+        return result;
+    }
+
+    void remove(entity_id id)
+    {
+        if(!nodes_.contains(id)) { return; }
+        nodes_.remove(id);
+        dirty_ = true;
+    }
+
+    const std::vector<entity_id>& order()
+    {
+        rebuild();
+        return order_;
+    }
+};
+
+// resumable position of a .each_budgeted() sweep, keep one per system between frames
+struct iteration_cursor
+{
+    std::vector<component_bitset> groups; // matching groups captured when the sweep started
+    size_t group  = 0;                    // group currently visited
+    size_t offset = tombstone;            // entities of the current group left to visit, groups are walked back to front
+
+    void reset()
+    {
+        groups.clear();
+        group  = 0;
+        offset = tombstone;
+    }
+};
+
+// lookup key of another type than the index, arithmetic keys of any width or signedness and strings of any kind
+// are converted to the key type of the index they are looked up in
+using lookup_key = std::variant<int64_t, uint64_t, long double, std::string_view>;
+
+class value_index_interface
+{
+public:
+    size_t update_connection = 0;
+    size_t remove_connection = 0;
+
+    virtual ~value_index_interface() = default;
+    virtual const std::type_info& key_type() = 0;
+    // key points to a key of exactly key_type()
+    virtual std::span<const entity_id> find_erased(const void* key) = 0;
+    virtual std::span<const entity_id> find_all(const lookup_key&) { return {}; }
+    virtual void erase(entity_id) {}
+};
+
+// entity ids bucketed by a key taken from their C component, Map decides whether buckets are hashed or sorted
+template <typename C, typename Key, template<typename...> typename Map = std::unordered_map>
+class value_index : public value_index_interface
+{
+private:
+    struct entry
+    {
+        Key key;
+        size_t slot; // position in buckets_[key]
+    };
+
+    std::function<Key(const C&)> key_fn_;
+    Map<Key, std::vector<entity_id>> buckets_;
+    sparse_set<entry> entries_;
+
+    void erase_from_bucket(const entry& e)
+    {
+        auto it = buckets_.find(e.key);
+        std::vector<entity_id>& ids = it->second;
+        entries_[ids.back()].slot = e.slot;
+        ids[e.slot] = ids.back();
+        ids.pop_back();
+        if(ids.empty()) { buckets_.erase(it); }
+    }
+
+public:
+    explicit value_index(std::function<Key(const C&)> key_fn) : key_fn_(std::move(key_fn)) {}
+
+    void update(entity_id id, const C& component)
+    {
+        Key key = key_fn_(component);
+
+        if(entries_.contains(id))
+        {
+            if(entries_[id].key == key) { return; }
+            erase_from_bucket(entries_[id]);
+        }
+
+        std::vector<entity_id>& ids = buckets_[key];
+        entries_.set(id, { key, ids.size() });
+        ids.push_back(id);
+    }
+
+    void erase(entity_id id)
+    {
+        if(!entries_.contains(id)) { return; }
+        erase_from_bucket(entries_[id]);
+        entries_.remove(id);
+    }
+
+    entity_id find(const Key& key)
+    {
+        auto it = buckets_.find(key);
+        return it == buckets_.end() ? null_entity : it->second.front();
+    }
+
+    std::span<const entity_id> find_all(const Key& key)
+    {
+        auto it = buckets_.find(key);
+        if(it == buckets_.end()) { return {}; }
+        return std::span<const entity_id>(it->second);
+    }
+
+    const std::type_info& key_type() { return typeid(Key); }
+
+    std::span<const entity_id> find_erased(const void* key) { return find_all(*static_cast<const Key*>(key)); }
+
+    // keys that dont survive the conversion to Key unchanged match nothing
+    std::span<const entity_id> find_all(const lookup_key& key)
+    {
+        return std::visit([this](const auto& value) -> std::span<const entity_id>
+        {
+            using Value = std::decay_t<decltype(value)>;
+            if constexpr(std::is_same_v<Value, std::string_view>)
+            {
+                if constexpr(std::is_constructible_v<Key, std::string_view>) { return find_all(Key(value)); }
+                else { return {}; }
+            }
+            else if constexpr(std::is_arithmetic_v<Key>)
+            {
+                Key converted = static_cast<Key>(value);
+                if(static_cast<Value>(converted) != value) { return {}; }
+                return find_all(converted);
+            }
+            else { return {}; }
+        }, key);
+    }
+
+    const Map<Key, std::vector<entity_id>>& buckets() { return buckets_; }
+};
+
+// bidirectional external 64 bit key <-> entity id mapping, an open addressing table (linear probing with backward shift
+// deletion) answers key -> entity and a plain array indexed by entity id answers entity -> key, nothing is allocated per key
+class external_id_map
+{
+private:
+    struct slot
+    {
+        uint64_t key;
+        entity_id id = null_entity; // null_entity marks an empty slot
+    };
+
+    std::vector<slot> slots_;
+    std::vector<uint64_t> keys_; // indexed by entity id
+    size_t size_ = 0;
+
+    static uint64_t hash(uint64_t key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+    size_t mask() const { return slots_.size() - 1; }
+
+    size_t find_slot(uint64_t key) const
+    {
+        if(slots_.empty()) { return tombstone; }
+        for(size_t i = hash(key) & mask(); slots_[i].id != null_entity; i = (i + 1) & mask())
+            if(slots_[i].key == key) { return i; }
+        return tombstone;
+    }
+
+    void insert_slot(uint64_t key, entity_id id)
+    {
+        size_t i = hash(key) & mask();
+        while(slots_[i].id != null_entity) { i = (i + 1) & mask(); }
+        slots_[i] = { key, id };
+    }
+
+    void grow()
+    {
+        std::vector<slot> old = std::move(slots_);
+        slots_.assign(std::max<size_t>(old.size() * 2, EXTERNAL_ID_MIN_CAPACITY), slot());
+        for(const slot& s : old)
+            if(s.id != null_entity) { insert_slot(s.key, s.id); }
+    }
+
+    void erase_slot(size_t hole)
+    {
+        // shift following entries back so probing never needs tombstones
+        for(size_t i = (hole + 1) & mask(); slots_[i].id != null_entity; i = (i + 1) & mask())
+        {
+            size_t home = hash(slots_[i].key) & mask();
+            if(((i - home) & mask()) >= ((i - hole) & mask()))
+            {
+                slots_[hole] = slots_[i];
+                hole = i;
+            }
+        }
+        slots_[hole] = slot();
+        size_--;
+    }
+
+public:
+    static constexpr uint64_t no_key = std::numeric_limits<uint64_t>::max();
+
+    // binding an entity again replaces its previous key, keys already used by another entity are refused
+    // no_key marks unbound entities so it can never be bound
+    bool bind(entity_id id, uint64_t key)
+    {
+        if(key == no_key) { return false; }
+
+        size_t existing = find_slot(key);
+        if(existing != tombstone) { return slots_[existing].id == id; }
+
+        unbind(id);
+        if((size_ + 1) * 2 > slots_.size()) { grow(); }
+        insert_slot(key, id);
+        size_++;
+
+        if(id >= keys_.size()) { keys_.resize(id + 1, no_key); }
+        keys_[id] = key;
+        return true;
+    }
+
+    void unbind(entity_id id)
+    {
+        uint64_t key = external_id(id);
+        if(key == no_key) { return; }
+        erase_slot(find_slot(key));
+        keys_[id] = no_key;
+    }
+
+    entity_id resolve(uint64_t key) const
+    {
+        size_t i = find_slot(key);
+        return i == tombstone ? null_entity : slots_[i].id;
+    }
+
+    uint64_t external_id(entity_id id) const { return id < keys_.size() ? keys_[id] : no_key; }
+
+    size_t size() const { return size_; }
+};
+
+class registry;
+
+// persistent query result, the registry inserts and erases entities as they enter or leave the query instead of recomputing it
+// with a comparator the ids are kept ordered, otherwise they are in insertion order with swap and pop removal
+// the comparator gets the registry on every call instead of holding on to it, so views stay valid when the registry is moved
+class materialized_view
+{
+private:
+    component_bitset mask_;
+    std::vector<entity_id> ids_;
+    sparse_index positions_; // id -> position in ids_
+    std::function<bool(registry&, entity_id, entity_id)> less_;
+
+    void reindex(size_t from, size_t to)
+    {
+        for(size_t i = from; i < to; i++) { positions_.set(ids_[i], i); }
+    }
+
+public:
+    size_t update_connection = tombstone; // keeps sorted views ordered when the sort component changes
+
+    materialized_view(component_bitset mask, std::function<bool(registry&, entity_id, entity_id)> less = nullptr)
+        : mask_(mask), less_(std::move(less)) {}
+
+    const component_bitset& mask() const { return mask_; }
+
+    bool contains(entity_id id) const { return positions_.get(id) != tombstone; }
+
+    void insert(registry& reg, entity_id id)
+    {
+        if(contains(id)) { return; }
+
+        if(!less_)
+        {
+            positions_.set(id, ids_.size());
+            ids_.push_back(id);
+            return;
+        }
+
+        auto less = [&](entity_id a, entity_id b) { return less_(reg, a, b); };
+        size_t position = std::upper_bound(ids_.begin(), ids_.end(), id, less) - ids_.begin();
+        ids_.insert(ids_.begin() + position, id);
+        reindex(position, ids_.size());
+    }
+
+    void erase(entity_id id)
+    {
+        size_t position = positions_.get(id);
+        if(position == tombstone) { return; }
+        positions_.set(id, tombstone);
+
+        if(!less_)
+        {
+            ids_[position] = ids_.back();
+            ids_.pop_back();
+            if(position < ids_.size()) { positions_.set(ids_[position], position); }
+            return;
+        }
+
+        ids_.erase(ids_.begin() + position);
+        reindex(position, ids_.size());
+    }
+
+    // moves id to its new place after its sort key changed
+    void reorder(registry& reg, entity_id id)
+    {
+        if(!less_ || !contains(id)) { return; }
+        erase(id);
+        insert(reg, id);
+    }
+
+    std::span<const entity_id> ids() const { return ids_; }
+
+    std::vector<entity_id>::const_iterator begin() const { return ids_.begin(); }
+    std::vector<entity_id>::const_iterator end() const { return ids_.end(); }
+
+    size_t size() const { return ids_.size(); }
+    bool empty() const { return ids_.empty(); }
+};
+
+// read only state of some pools at the moment registry::snapshot_view() was called, other threads can read it while the registry keeps changing
+// the pools are shared with the registry, reads on either side never copy, the first write to a shared pool copies its ids and sparse index
+// and sparse sets then copy only the dense pages that get written (same as .fork())
+// a pool is freed once neither the registry nor any snapshot holds it anymore
+template <typename ...Components>
+class snapshot
+{
+private:
+    std::vector<entity_id> ids_; // enabled entities that had every component
+    std::tuple<std::shared_ptr<storage_t<Components>>...> pools_;
+
+public:
+    snapshot(std::vector<entity_id> ids, std::shared_ptr<storage_t<Components>>... pools) : ids_(std::move(ids)), pools_(std::move(pools)...) {}
+
+    template<typename C>
+    bool contains(entity_id id) { return std::get<std::shared_ptr<storage_t<C>>>(pools_)->contains(id); }
+
+    template<typename C>
+    component_cref_t<C> get(entity_id id) { return read_component<C>(*std::get<std::shared_ptr<storage_t<C>>>(pools_), id); }
+
+    // [](entity_id, const Components&...) or [](const Components&...)
+    template<typename Func>
+    void each(Func&& func)
+    {
+        for(entity_id id : ids_)
+        {
+            if constexpr(std::is_invocable_v<Func, entity_id, component_cref_t<Components>...>)
+                func(id, get<Components>(id)...);
+            else
+                func(get<Components>(id)...);
+        }
+    }
+
+    std::span<const entity_id> ids() const { return ids_; }
+
+    size_t size() const { return ids_.size(); }
+};
+
+// handle bound to the pool of C, skips the type lookup of the registry on every call so hot code can keep one per system
+// it stays valid for the lifetime of the registry
+template <typename C>
+class storage_ref
+{
+private:
+    registry* registry_;
+    size_t position_;
+
+public:
+    storage_ref(registry& reg, size_t position) : registry_(&reg), position_(position) {}
+
+    component_ref_t<C> get(entity_id id) { return pool()[id]; }
+
+    // nullptr (an empty optional for soa pools) when id does not have C
+    component_ptr_t<C> try_get(entity_id id) { return pool().try_get(id); }
+
+    bool contains(entity_id id) { return readable_pool().contains(id); }
+
+    // same as registry::emplace<C>()
+    void emplace(entity_id id, C component = {});
+
+    // same as registry::remove<C>()
+    void remove(entity_id id);
+
+    size_t size() { return readable_pool().size(); }
+
+    // resolved by position on every call so a pool shared after .fork() is copied before it is written
+    storage_t<C>& pool();
+
+    // same pool without the copy, for calls that do not write
+    storage_t<C>& readable_pool();
+};
+
+// callbacks of one component type, connections are identified by the id returned on connect
+struct component_listeners
+{
+    std::vector<std::pair<size_t, std::function<void(registry&, entity_id)>>> on_update;
+    std::vector<std::pair<size_t, std::function<void(registry&, entity_id)>>> on_remove;
+};
+
+// entities matching mask bucketed by their Key component for .each_grouped(), kept up to date like a materialized_view
+struct grouped_partition
+{
+    component_bitset mask;
+    size_t key_position = tombstone;
+    std::unique_ptr<value_index_interface> index;     // a value_index<Key, Key, std::map>
+    std::function<void(registry&, entity_id)> insert; // reads the Key of an entity that entered the query
+    size_t update_connection = tombstone;             // moves entities between buckets when their Key changes
+};
+
+// brackets writes made through references so readers in other processes see them as one change, see registry::write_scope()
+class write_scope
+{
+private:
+    std::vector<sparse_set_interface*> pools_;
+
+public:
+    explicit write_scope(std::vector<sparse_set_interface*> pools) : pools_(std::move(pools))
+    {
+        for(sparse_set_interface* pool : pools_) { pool->begin_write(); }
+    }
+
+    write_scope(const write_scope&) = delete;
+    write_scope& operator=(const write_scope&) = delete;
+
+    ~write_scope()
+    {
+        for(sparse_set_interface* pool : pools_) { pool->end_write(); }
+    }
+};
+
+class registry
+{
+    template <typename C>
+    friend class storage_ref;
+
+private:    
+    std::queue<entity_id> available_entity_ids_;
+    std::vector<std::shared_ptr<sparse_set_interface>> component_pools_; // shared with forks until written, index of specific components pool is its position in component bitset (component_bit_positions_[component_type])
+    std::unordered_map<component_bitset, sparse_set<entity_id>> enitity_groups_;
+    std::unordered_map<component_type, size_t> component_bit_positions_;
+    sparse_set<component_bitset> component_bitsets_;
+    hierarchy hierarchy_;
+    external_id_map external_ids_;
+    std::vector<component_listeners> component_listeners_; // indexed like component_pools_
+    std::vector<std::unique_ptr<value_index_interface>> component_indices_; // indexed like component_pools_, .index() creates them
+    std::vector<std::unique_ptr<grouped_partition>> grouped_partitions_; // one per .each_grouped() query
+    std::vector<std::unique_ptr<materialized_view>> materialized_views_;
+    size_t next_connection_ = 0;
+
+    size_t entity_limit_ = 0;
+
+    struct fork_tag {};
+
+    // pools are shared, everything else that describes entities is copied, listeners and the indices/views built on them are not
+    registry(registry& parent, fork_tag)
+        : available_entity_ids_(parent.available_entity_ids_), component_pools_(parent.component_pools_), enitity_groups_(parent.enitity_groups_),
+          component_bit_positions_(parent.component_bit_positions_), component_bitsets_(parent.component_bitsets_), hierarchy_(parent.hierarchy_),
+          external_ids_(parent.external_ids_), component_listeners_(parent.component_pools_.size()), component_indices_(parent.component_pools_.size()),
+          entity_limit_(parent.entity_limit_)
+    {
+        for(std::shared_ptr<sparse_set_interface>& pool : component_pools_)
+            if(pool->process_shared()) { pool = pool->clone(); }
+    }
+
+    size_t add_pool(const component_type& type, std::shared_ptr<sparse_set_interface> pool)
+    {
+        LAMECS_ASSERT(component_bit_positions_.size() >= MAX_COMPONENT_COUNT, "Maximum component limit reached, cant register component");
+        component_bit_positions_[type] = component_pools_.size();
+        component_pools_.push_back(std::move(pool)); 
+        component_listeners_.emplace_back();
+        component_indices_.emplace_back();
+        return component_pools_.size() - 1;
+    }
+
+    // position of the pool of type here, registries only know each others pools by type name so a missing one is created like prototype
+    size_t adopt_pool(const component_type& type, sparse_set_interface& prototype)
+    {
+        auto it = component_bit_positions_.find(type);
+        if(it != component_bit_positions_.end()) { return it->second; }
+        return add_pool(type, prototype.make_empty());
+    }
+
+    // copy on write, a pool still shared with a fork is copied before anyone gets mutable access to it
+    sparse_set_interface* writable_pool(size_t position)
+    {
+        std::shared_ptr<sparse_set_interface>& pool = component_pools_[position];
+        if(pool.use_count() > 1) { pool = pool->clone(); }
+        return pool.get();
+    }
+
+    // reads go to the shared pool as is, sparse sets then copy only the dense pages that get written
+    sparse_set_interface* readable_pool(size_t position) { return component_pools_[position].get(); }
+
+    // a published pool has to stay with the registry that writes it, so a snapshot gets a private copy of it instead
+    template<typename C>
+    std::shared_ptr<storage_t<C>> snapshot_pool()
+    {
+        std::shared_ptr<sparse_set_interface>& pool = component_pools_[get_component_position<C>()];
+        return std::static_pointer_cast<storage_t<C>>(pool->process_shared() ? pool->clone() : pool);
+    }
+
+    template<typename C>
+    size_t get_component_position()
+    {
+        component_type type = get_component_type<C>();
+        if(!component_bit_positions_.contains(type)) { return tombstone; }
+        return component_bit_positions_.at(type);
+    }
+
+    template<typename C>
+    storage_t<C>& get_component_pool(bool register_when_not_found = true)
+    {
+        size_t position = get_component_position<C>();
+        if(position == tombstone)
+        {
+            LAMECS_ASSERT(!register_when_not_found, "registry dont have component type: " << typeid(C).name());
+            register_component<C>();
+            position = get_component_position<C>();
+        }
+
+        // the position map is keyed by type so the pool is known to be a storage_t<C>
+        return *static_cast<storage_t<C>*>(writable_pool(position));
+    }
+
+    template<typename C>
+    storage_t<C>& get_readable_pool()
+    {
+        size_t position = get_component_position<C>();
+        LAMECS_ASSERT(position == tombstone, "registry dont have component type: " << typeid(C).name());
+        return *static_cast<storage_t<C>*>(readable_pool(position));
+    }
+
+    // lambdas with a non template call operator that take const references or copies only read their components
+    // generic lambdas and soa proxies count as writers
+    template<typename Func, typename ...Components>
+    static constexpr bool reads_only()
+    {
+        using F = std::remove_cvref_t<Func>;
+        if constexpr(!(std::is_reference_v<component_ref_t<Components>> && ...) || !requires { &F::operator(); })
+            return false;
+        else
+            return std::is_invocable_v<F&, entity_id, component_cref_t<Components>...> || std::is_invocable_v<F&, component_cref_t<Components>...>;
+    }
+
+    template<typename Func, typename ...Components>
+    std::tuple<storage_t<Components>&...> pools_for()
+    {
+        if constexpr(reads_only<Func, Components...>())
+            return std::tuple<storage_t<Components>&...>(get_readable_pool<Components>()...);
+        else
+            return std::tuple<storage_t<Components>&...>(get_component_pool<Components>(false)...);
+    }
+
+    component_bitset& get_component_bitset(entity_id id, bool create_when_not_found = true)
+    {
+        if(!component_bitsets_.contains(id))
+        {
+            if(create_when_not_found) { component_bitsets_.push(id, component_bitset()); }
+            else { LAMECS_ASSERT(true, "Entity: " << id << " does not exist"); } // currently we wont hit with this situation but get_component_pool() also does similar stuff so why not adding this ?
+        }
+        return component_bitsets_[id];
+    }
+
+    template<typename C>
+    void set_bitset_bit(component_bitset& bitset, bool value) 
+    { 
+        size_t bitset_position = get_component_position<C>();
+        LAMECS_ASSERT(bitset_position == tombstone, "registry dont have component type: " << typeid(C).name());
+        bitset[bitset_position] = value;
+    }
+
+    template<typename... Components> 
+    component_bitset get_component_bitset_mask()
+    {
+        component_bitset mask;
+        (set_bitset_bit<Components>(mask, 1), ...);
+        return mask;
+    }   
+
+    void remove_entity_from_group(component_bitset bitset, entity_id id)
+    {
+        enitity_groups_.emplace(std::piecewise_construct,
+				std::forward_as_tuple(bitset),
+				std::forward_as_tuple());
+        sparse_set<entity_id>& group = enitity_groups_.at(bitset);
+        group.remove(id);
+        if(group.empty()) { enitity_groups_.erase(bitset); }
+    }
+
+    void add_entity_to_group(component_bitset bitset, entity_id id)
+    {
+        enitity_groups_.emplace(std::piecewise_construct,
+				std::forward_as_tuple(bitset),
+				std::forward_as_tuple());
+        enitity_groups_[bitset].push(id, id);
+    }
+
+    bool generate_available_entity_chuck()
+    {
+        if(entity_limit_ == MAX_ENTITY_COUNT) { return false; }
+        size_t new_limit = std::min(entity_limit_+ENTITY_CHUNK_SIZE, MAX_ENTITY_COUNT);
+        for(entity_id i = entity_limit_; i < new_limit; i++) { available_entity_ids_.push(i); }
+        entity_limit_ = new_limit;
+        return true;
+    }
+
+    template<typename C>
+    component_ref_t<C> get(entity_id id)
+    {
+        component_ptr_t<C> component = get_component_pool<C>(false).try_get(id);
+        LAMECS_ASSERT(!component, "Entity: " << id << " does not have component " << get_component_type<C>() << " during .get() call");
+        return *component;
+    }
+
+    template<typename C>
+    component_cref_t<C> read(entity_id id)
+    {
+        auto component = try_read_component<C>(get_readable_pool<C>(), id);
+        LAMECS_ASSERT(!component, "Entity: " << id << " does not have component " << get_component_type<C>() << " during .get() call");
+        return *component;
+    }
+
+    template<typename C>
+    auto try_read_one(entity_id id)
+    {
+        using pointer = decltype(try_read_component<C>(std::declval<storage_t<C>&>(), id));
+        size_t position = get_component_position<C>();
+        if(position == tombstone) { return pointer(); }
+        return try_read_component<C>(*static_cast<storage_t<C>*>(readable_pool(position)), id);
+    }
+
+    template<typename C>
+    component_ptr_t<C> try_get_one(entity_id id)
+    {
+        size_t position = get_component_position<C>();
+        if(position == tombstone) { return component_ptr_t<C>(); }
+        return static_cast<storage_t<C>*>(writable_pool(position))->try_get(id);
+    }
+
+    template<typename C>
+    inline component_type get_component_type() { return typeid(C).name(); }
+
+    // disabled groups are only visited when the target mask asks for them
+    inline bool group_matches(const component_bitset& mask, const component_bitset& target_mask)
+    {
+        return (mask & target_mask) == target_mask && !mask[DISABLED_BIT];
+    }
+
+    template<typename ...Components, typename Func>
+    void invoke(Func& func, entity_id id)
+    {
+        // [](entity_id id, const Component& c1, ...) reads without copying pools shared with a fork or snapshot
+        if constexpr(reads_only<Func, Components...>())
+        {
+            if constexpr(std::is_invocable_v<Func&, entity_id, component_cref_t<Components>...>)
+                func(id, read<Components>(id)...);
+            else
+                func(read<Components>(id)...);
+        }
+        // [](entity_id id, Component c1, Component c2, ...)
+        else if constexpr(std::is_invocable_v<Func, entity_id, component_ref_t<Components>...>)
+            func(id, get<Components>(id)...);
+        // [](Component c1, Component c2, ...)
+        else if constexpr(std::is_invocable_v<Func, component_ref_t<Components>...>)
+            func(get<Components>(id)...);
+        else
+            LAMECS_ASSERT(true, "Bad lambda provided for .each(), parameter pack dosent match to lambda args");
+    }
+
+    template<typename ...Components, typename Func, typename Budget>
+    bool each_budgeted_impl(iteration_cursor& cursor, Func& func, Budget&& out_of_budget)
+    {
+        if(cursor.groups.empty())
+        {
+            const component_bitset& target_mask = get_component_bitset_mask<Components...>();
+            for(auto& [mask, group] : enitity_groups_)
+                if(group_matches(mask, target_mask)) { cursor.groups.push_back(mask); }
+            cursor.group  = 0;
+            cursor.offset = tombstone;
+        }
+
+        size_t visited = 0;
+        for(; cursor.group < cursor.groups.size(); cursor.group++, cursor.offset = tombstone)
+        {
+            auto it = enitity_groups_.find(cursor.groups[cursor.group]);
+            if(it == enitity_groups_.end()) { continue; }
+
+            const std::vector<entity_id>& ids = it->second.ids();
+            cursor.offset = std::min(cursor.offset, ids.size());
+
+            while(cursor.offset > 0)
+            {
+                if(out_of_budget(visited)) { return false; }
+                cursor.offset--;
+                invoke<Components...>(func, ids[cursor.offset]);
+                visited++;
+            }
+        }
+
+        cursor.reset();
+        return true;
+    }
+
+    // emplace/remove once the pool and bit position of C are known
+    template<typename C>
+    void emplace_at(storage_t<C>& pool, size_t position, entity_id id, C&& component)
+    {
+        pool.set(id, std::move(component));
+        component_bitset& bitset = get_component_bitset(id);
+
+        if(!bitset[position])
+        {
+            component_bitset old_bitset = bitset;
+            remove_entity_from_group(bitset, id);
+            bitset[position] = 1;
+            add_entity_to_group(bitset, id);
+            update_views(old_bitset, bitset, id);
+        }
+        notify(component_listeners_[position].on_update, id);
+    }
+
+    template<typename C>
+    void remove_at(storage_t<C>& pool, size_t position, entity_id id)
+    {
+        if(!pool.contains(id)) { return; }
+        notify(component_listeners_[position].on_remove, id);
+        pool.remove(id);
+
+        component_bitset& bitset = get_component_bitset(id, false);
+        component_bitset old_bitset = bitset;
+        remove_entity_from_group(bitset, id);
+        bitset[position] = 0;
+        add_entity_to_group(bitset, id);
+        update_views(old_bitset, bitset, id);
+    }
+
+    void destroy_entity(entity_id id)
+    {
+        if(!contains_entity(id))
+        {
+            LAMECS_INFO("Entity: " << id << " does not exist");
+            return;
+        }
+
+        component_bitset deleted_bitset = get_component_bitset(id);
+        for(size_t i = 0; i < MAX_COMPONENT_COUNT; i++)
+            if(deleted_bitset[i] == 1) { notify(component_listeners_[i].on_remove, id); }
+
+        component_bitsets_.remove(id);
+        external_ids_.unbind(id);
+        available_entity_ids_.push(id);
+        remove_entity_from_group(deleted_bitset, id);
+        update_views(deleted_bitset, component_bitset(), id);
+        for(size_t i = 0; i < MAX_COMPONENT_COUNT; i++)
+            if(deleted_bitset[i] == 1) { writable_pool(i)->remove(id); }
+    }
+
+    template<typename C, typename Key, template<typename...> typename Map>
+    value_index<C, Key, Map>& create_index(std::vector<std::unique_ptr<value_index_interface>>& slots, std::function<Key(const C&)> key_fn)
+    {
+        get_component_pool<C>();
+        std::unique_ptr<value_index_interface>& slot = slots[get_component_position<C>()];
+        if(slot)
+        {
+            disconnect(slot->update_connection);
+            disconnect(slot->remove_connection);
+        }
+
+        auto index = std::make_unique<value_index<C, Key, Map>>(std::move(key_fn));
+        value_index<C, Key, Map>* ptr = index.get();
+        slot = std::move(index);
+
+        auto insert = [ptr](entity_id id, const C& component) { ptr->update(id, component); };
+        each<C>(insert);
+        each_disabled<C>(insert);
+        ptr->update_connection = on_update<C>(insert);
+        ptr->remove_connection = on_remove<C>([ptr](entity_id id) { ptr->erase(id); });
+        return *ptr;
+    }
+
+    // ids whose indexed key equals key, the index is looked up with its own key type when key has it and through
+    // lookup_key for other arithmetic types and strings, anything else matches nothing
+    template<typename C, typename Key>
+    std::span<const entity_id> find_in_index(const Key& lookup)
+    {
+        using Decayed = std::decay_t<const Key&>;
+        const Decayed& key = lookup; // string literals arrive as char arrays and decay to a temporary pointer
+        size_t position = get_component_position<C>();
+        value_index_interface* index = position == tombstone ? nullptr : component_indices_[position].get();
+        if(index == nullptr)
+        {
+            LAMECS_INFO("No index for component " << typeid(C).name());
+            return {};
+        }
+
+        if(index->key_type() == typeid(Decayed)) { return index->find_erased(&key); }
+
+        if constexpr(std::is_arithmetic_v<Decayed>)
+        {
+            if constexpr(std::is_floating_point_v<Decayed>) { return index->find_all(lookup_key(static_cast<long double>(key))); }
+            else if constexpr(std::is_signed_v<Decayed>) { return index->find_all(lookup_key(static_cast<int64_t>(key))); }
+            else { return index->find_all(lookup_key(static_cast<uint64_t>(key))); }
+        }
+        else if constexpr(std::is_convertible_v<const Decayed&, std::string_view>)
+        {
+            return index->find_all(lookup_key(std::string_view(key)));
+        }
+
+        LAMECS_INFO("Index of component " << typeid(C).name() << " has another key type than " << typeid(Key).name());
+        return {};
+    }
+
+    void update_views(const component_bitset& old_bitset, const component_bitset& new_bitset, entity_id id)
+    {
+        for(std::unique_ptr<materialized_view>& view : materialized_views_)
+        {
+            bool was = group_matches(old_bitset, view->mask());
+            bool is  = group_matches(new_bitset, view->mask());
+            if(was && !is) { view->erase(id); }
+            else if(!was && is) { view->insert(*this, id); }
+        }
+
+        for(std::unique_ptr<grouped_partition>& partition : grouped_partitions_)
+        {
+            bool was = group_matches(old_bitset, partition->mask);
+            bool is  = group_matches(new_bitset, partition->mask);
+            if(was && !is) { partition->index->erase(id); }
+            else if(!was && is) { partition->insert(*this, id); }
+        }
+    }
+
+    template<typename Key, typename ...Components>
+    grouped_partition& get_grouped_partition()
+    {
+        const component_bitset& mask = get_component_bitset_mask<Key, Components...>();
+        size_t key_position = get_component_position<Key>();
+        for(std::unique_ptr<grouped_partition>& partition : grouped_partitions_)
+            if(partition->mask == mask && partition->key_position == key_position) { return *partition; }
+
+        auto index = std::make_unique<value_index<Key, Key, std::map>>([](const Key& key) { return key; });
+        value_index<Key, Key, std::map>* ptr = index.get();
+
+        grouped_partitions_.push_back(std::make_unique<grouped_partition>());
+        grouped_partition& partition = *grouped_partitions_.back();
+        partition.mask = mask;
+        partition.key_position = key_position;
+        partition.index = std::move(index);
+        partition.insert = [ptr](registry& reg, entity_id id) { ptr->update(id, reg.read<Key>(id)); };
+
+        for(auto& [group_mask, group] : enitity_groups_)
+            if(group_matches(group_mask, mask))
+                for(entity_id id : group.ids()) { partition.insert(*this, id); }
+
+        partition.update_connection = connect_update(key_position, [ptr, mask](registry& reg, entity_id id)
+        {
+            if(reg.group_matches(reg.get_component_bitset(id, false), mask)) { ptr->update(id, reg.read<Key>(id)); }
+        });
+        return partition;
+    }
+
+    // copies the C component of every id into out for .each_grouped()
+    template<typename C>
+    static void gather_bucket(storage_t<C>& pool, std::vector<C>& out, std::span<const entity_id> ids)
+    {
+        out.resize(ids.size());
+        for(size_t i = 0; i < ids.size(); i++)
+        {
+            prefetch_ahead(pool, ids, i);
+            out[i] = read_component<C>(pool, ids[i]);
+        }
+    }
+
+    materialized_view& add_view(component_bitset mask, std::function<bool(registry&, entity_id, entity_id)> less)
+    {
+        materialized_views_.push_back(std::make_unique<materialized_view>(mask, std::move(less)));
+        materialized_view& view = *materialized_views_.back();
+
+        for(auto& [group_mask, group] : enitity_groups_)
+            if(group_matches(group_mask, mask))
+                for(entity_id id : group.ids()) { view.insert(*this, id); }
+        return view;
+    }
+
+    // listeners that need the registry take it as an argument, a captured this would dangle once the registry is moved
+    size_t connect_update(size_t position, std::function<void(registry&, entity_id)> listener)
+    {
+        component_listeners_[position].on_update.emplace_back(next_connection_, std::move(listener));
+        return next_connection_++;
+    }
+
+    void notify(const std::vector<std::pair<size_t, std::function<void(registry&, entity_id)>>>& listeners, entity_id id)
+    {
+        for(auto& [connection, listener] : listeners) { listener(*this, id); }
+    }
+
+    // entity ids of every matching group cut into ITERATION_CHUNK_SIZE pieces
+    template<typename ...Components>
+    std::vector<std::span<const entity_id>> matching_chunks()
+    {
+        const component_bitset& target_mask = get_component_bitset_mask<Components...>();
+        std::vector<std::span<const entity_id>> chunks;
+
+        for(auto& [mask, group] : enitity_groups_)
+        {
+            if(!group_matches(mask, target_mask)) { continue; }
+            const std::vector<entity_id>& ids = group.ids();
+            for(size_t offset = 0; offset < ids.size(); offset += ITERATION_CHUNK_SIZE)
+                chunks.emplace_back(ids.data() + offset, std::min(ITERATION_CHUNK_SIZE, ids.size() - offset));
+        }
+        return chunks;
+    }
+
+    // while reading ids[i] the sparse slot of ids[i + 2 * PREFETCH_DISTANCE] and the component of ids[i + PREFETCH_DISTANCE] are requested
+    template<typename Pool>
+    static void prefetch_ahead(Pool& pool, std::span<const entity_id> ids, size_t i)
+    {
+        if constexpr(requires { pool.prefetch_sparse(entity_id()); })
+            if(i + 2 * PREFETCH_DISTANCE < ids.size()) { pool.prefetch_sparse(ids[i + 2 * PREFETCH_DISTANCE]); }
+        if constexpr(requires { pool.prefetch_dense(entity_id()); })
+            if(i + PREFETCH_DISTANCE < ids.size()) { pool.prefetch_dense(ids[i + PREFETCH_DISTANCE]); }
+    }
+
+    // func gets const references, nothing is written so pools shared with a fork or snapshot are safe to read from several threads
+    template<typename ...Components, typename Func>
+    static decltype(auto) read_entity(Func& func, std::tuple<storage_t<Components>&...>& pools, entity_id id)
+    {
+        return std::apply([&](storage_t<Components>&... pool) -> decltype(auto)
+        {
+            if constexpr(std::is_invocable_v<Func&, entity_id, component_cref_t<Components>...>)
+                return func(id, read_component<Components>(pool, id)...);
+            else
+                return func(read_component<Components>(pool, id)...);
+        }, pools);
+    }
+
+    // pools come from pools_for<Func, Components...>()
+    template<typename ...Components, typename Func>
+    static decltype(auto) map_entity(Func& func, std::tuple<storage_t<Components>&...>& pools, entity_id id)
+    {
+        if constexpr(reads_only<Func, Components...>())
+            return read_entity<Components...>(func, pools, id);
+        else
+            return std::apply([&](storage_t<Components>&... pool) -> decltype(auto)
+            {
+                if constexpr(std::is_invocable_v<Func, entity_id, decltype(pool[id])...>)
+                    return func(id, pool[id]...);
+                else
+                    return func(pool[id]...);
+            }, pools);
+    }
+
+    void set_enabled(entity_id id, bool enabled)
+    {
+        if(!contains_entity(id))
+        {
+            LAMECS_INFO("Entity: " << id << " does not exist");
+            return;
+        }
+
+        component_bitset& bitset = get_component_bitset(id, false);
+        if(bitset[DISABLED_BIT] != enabled) { return; }
+
+        component_bitset old_bitset = bitset;
+        remove_entity_from_group(bitset, id);
+        bitset[DISABLED_BIT] = !enabled;
+        add_entity_to_group(bitset, id);
+        update_views(old_bitset, bitset, id);
+    }
+
+    inline bool contains_entity(entity_id id) { return component_bitsets_.contains(id); }
+
+    // no entity can have a component type that was never registered
+    template<typename ...Components>
+    inline bool registered() { return ((get_component_position<Components>() != tombstone) && ...); }
+
+public:
+    registry() 
+    {
+        generate_available_entity_chuck();
+    }
+
+    template <typename C>
+    void emplace(entity_id id, C&& component={})
+    {
+        if(id == null_entity)
+        {
+            LAMECS_INFO("Entity is not valid");
+            return;
+        }
+
+        storage_t<C>& pool = get_component_pool<C>();
+        emplace_at<C>(pool, get_component_position<C>(), id, std::move(component));
+    }
+
+    // handle to the pool of C, registers C if needed
+    template <typename C>
+    storage_ref<C> storage()
+    {
+        get_component_pool<C>();
+        return storage_ref<C>(*this, get_component_position<C>());
+    }
+
+    // modifies the component in place and lets .on_update() listeners know about it
+    template <typename C, typename Func>
+    void patch(entity_id id, Func&& func)
+    {
+        func(get<C>(id));
+        notify(component_listeners_[get_component_position<C>()].on_update, id);
+    }
+
+    template <typename C>
+    void remove(entity_id id)
+    {
+        if(!contains_entity(id))
+        {
+            LAMECS_INFO("Entity: " << id << " does not exist");
+            return;
+        }
+
+        storage_t<C>& pool = get_component_pool<C>();
+        remove_at<C>(pool, get_component_position<C>(), id);
+    }
+
+    // children are removed together with their parent
+    void remove_entity(entity_id &id)
+    {
+        if(hierarchy_.contains(id))
+        {
+            for(entity_id member : hierarchy_.subtree(id)) { hierarchy_.remove(member); destroy_entity(member); }
+            return;
+        }
+
+        destroy_entity(id);
+    }
+
+    // associates an external 64 bit key (e.g. a database primary key) with id, returns false if key belongs to another entity or is no_key
+    // the key is dropped when the entity is removed, external_id_map::no_key is reserved
+    bool bind_external(entity_id id, uint64_t key) { return external_ids_.bind(id, key); }
+
+    void unbind_external(entity_id id) { external_ids_.unbind(id); }
+
+    // null_entity when key is not bound
+    entity_id resolve(uint64_t key) { return external_ids_.resolve(key); }
+
+    void resolve(std::span<const uint64_t> keys, std::span<entity_id> out)
+    {
+        LAMECS_ASSERT(out.size() < keys.size(), "Output span is smaller than key span in .resolve()");
+        for(size_t i = 0; i < keys.size(); i++) { out[i] = external_ids_.resolve(keys[i]); }
+    }
+
+    // external_id_map::no_key when id has no external key
+    uint64_t external_id(entity_id id) { return external_ids_.external_id(id); }
+
+    // parent = null_entity detaches child
+    void set_parent(entity_id child, entity_id parent) { hierarchy_.set_parent(child, parent); }
+
+    entity_id parent_of(entity_id id) { return hierarchy_.parent(id); }
+
+    // children of a parent are stored contiguously
+    std::span<const entity_id> children(entity_id id) { return hierarchy_.children(id); }
+
+    size_t depth(entity_id id) { return hierarchy_.depth(id); }
+
+    // walks every entity of the hierarchy once, parents before children, e.g. for transform propagation
+    // [](entity_id id, entity_id parent, Component c1, Component c2, ...), roots get null_entity as parent
+    // ids come in breadth first order but components stay in pool order, so each entity costs one bitset and one pool lookup per component
+    template<typename ...Components, typename Func>
+    void each_parent_first(Func&& func)
+    {
+        const component_bitset& target_mask = get_component_bitset_mask<Components...>();
+        std::tuple<storage_t<Components>&...> pools(get_component_pool<Components>(false)...);
+
+        std::apply([&](storage_t<Components>&... pool)
+        {
+            for(entity_id id : hierarchy_.order())
+            {
+                const component_bitset* bitset = component_bitsets_.try_read(id);
+                if(bitset != nullptr && group_matches(*bitset, target_mask)) { func(id, hierarchy_.parent(id), pool[id]...); }
+            }
+        }, pools);
+    }
+
+    template<typename C>
+    void register_component() { add_pool(get_component_type<C>(), std::make_shared<storage_t<C>>()); }
+
+    // read .prev<C>() and write .next<C>() during a step, .swap_buffers() flips them between steps
+    // a component that is already registered gets its next buffer filled with the current values once
+    template<typename C>
+    void register_component(double_buffered_t)
+    {
+        static_assert(std::is_same_v<storage_t<C>, sparse_set<C>>, "only components stored in a sparse_set can be double buffered");
+        if(get_component_position<C>() == tombstone) { register_component<C>(); }
+        get_component_pool<C>(false).enable_double_buffering();
+    }
+
+    // func(entity_id, const C&) runs after C is added or replaced by .emplace() or changed through .patch()
+    // changes made through plain references are not seen
+    template<typename C, typename Func>
+    size_t on_update(Func&& func)
+    {
+        get_component_pool<C>();
+        return connect_update(get_component_position<C>(), [func](registry& reg, entity_id id)
+        {
+            const C& component = reg.read<C>(id);
+            func(id, component);
+        });
+    }
+
+    // func(entity_id) runs before C is removed from an entity, the component can still be read
+    template<typename C, typename Func>
+    size_t on_remove(Func&& func)
+    {
+        get_component_pool<C>();
+        component_listeners_[get_component_position<C>()].on_remove.emplace_back(next_connection_, [func](registry&, entity_id id) { func(id); });
+        return next_connection_++;
+    }
+
+    // keeps an index from key_fn(component) to entity ids up to date on .emplace(), .patch() and removal
+    // buckets are hashed by default, index<C, std::map>(key_fn) keeps them sorted
+    // a component type has at most one index, calling this again replaces it and invalidates the returned index
+    // the returned index takes its exact key type, so lookups on it never depend on how a literal was deduced
+    template<typename C, template<typename...> typename Map = std::unordered_map, typename KeyFn>
+    auto& index(KeyFn&& key_fn)
+    {
+        using Key = std::decay_t<std::invoke_result_t<KeyFn, const C&>>;
+        return create_index<C, Key, Map>(component_indices_, std::forward<KeyFn>(key_fn));
+    }
+
+    // first entity whose indexed key equals key or null_entity
+    // arithmetic keys and strings (literals, const char*, std::string_view) are converted to the key type of the index
+    template<typename C, typename Key>
+    entity_id find(const Key& key)
+    {
+        std::span<const entity_id> ids = find_in_index<C>(key);
+        return ids.empty() ? null_entity : ids.front();
+    }
+
+    template<typename C, typename Key>
+    std::span<const entity_id> find_all(const Key& key) { return find_in_index<C>(key); }
+
+    void disconnect(size_t connection)
+    {
+        auto matches = [connection](auto& listener) { return listener.first == connection; };
+        for(component_listeners& listeners : component_listeners_)
+        {
+            std::erase_if(listeners.on_update, matches);
+            std::erase_if(listeners.on_remove, matches);
+        }
+    }
+
+    // new registry sharing every component pool with this one, reads never copy and the first write to a shared pool copies its ids
+    // and sparse index while sparse sets keep sharing dense pages until one is written, so component data costs O(pools) at fork time
+    // entity bookkeeping (free ids, bitsets, groups, hierarchy, external ids) is copied right away, so forking itself is O(entities)
+    // listeners, indices and views are not carried over
+    registry fork() { return registry(*this, fork_tag()); }
+
+    // value of a double buffered component as of the last .swap_buffers(), same as what .each() and .get_entity() see
+    template<typename C>
+    const C& prev(entity_id id) { return read<C>(id); }
+
+    // value a double buffered component gets at the next .swap_buffers()
+    // after a swap it holds the value from two steps ago, so systems should write next for every entity they update
+    template<typename C>
+    C& next(entity_id id) { return get_component_pool<C>(false).next(id); }
+
+    // flips every double buffered pool, O(1) per pool
+    void swap_buffers()
+    {
+        for(size_t i = 0; i < component_pools_.size(); i++)
+            if(component_pools_[i]->double_buffered()) { writable_pool(i)->swap_buffers(); }
+    }
+
+    // until the returned scope ends shm_reader sees every change to the published pools of Components as one, e.g.
+    // { auto scope = reg.write_scope<pos>(); reg.each<pos>(...); }, pools that are not published ignore it
+    template<typename ...Components>
+    lamecs::write_scope write_scope()
+    {
+        return lamecs::write_scope({ static_cast<sparse_set_interface*>(&get_component_pool<Components>(false))... });
+    }
+
+#ifdef LAMECS_SHM
+    // moves the pool of C (a shm_set) into the shared memory segment name, other processes read it with shm_reader<C>(name)
+    // the segment belongs to this registry, components moved in with .move_to() or .merge() land in it, forks and snapshots get private copies
+    template<typename C>
+    void publish(const std::string& name)
+    {
+        static_assert(std::is_same_v<storage_t<C>, shm_set<C>>, "only components stored in a shm_set can be published");
+        shm_set<C>& pool = get_component_pool<C>();
+        component_pools_[get_component_position<C>()] = std::make_shared<shm_set<C>>(name, pool);
+    }
+#endif
+
+    // consistent read only view of Components for other threads, taking it is O(matching entities) and copies no components
+    // must be called from the thread that changes the registry, the snapshot itself can be passed to and read from any thread
+    template<typename ...Components>
+    snapshot<Components...> snapshot_view()
+    {
+        std::vector<entity_id> ids;
+        const component_bitset& target_mask = get_component_bitset_mask<Components...>();
+        for(auto& [mask, group] : enitity_groups_)
+            if(group_matches(mask, target_mask)) { ids.insert(ids.end(), group.ids().begin(), group.ids().end()); }
+
+        return snapshot<Components...>(std::move(ids), snapshot_pool<Components>()...);
+    }
+
+    // old id -> id in the registry an entity was moved to
+    using id_translation = std::unordered_map<entity_id, entity_id>;
+
+    // moves ids with all of their components into other, components go pool by pool instead of entity by entity
+    // on_remove listeners here and on_update listeners there are notified, external ids move along
+    // parent links survive only when both ends move, children left behind lose their parent
+    id_translation move_to(registry& other, std::span<const entity_id> ids)
+    {
+        id_translation translation;
+        if(&other == this) { return translation; }
+
+        std::vector<entity_id> from, to;
+        component_bitset touched;
+        for(entity_id id : ids)
+        {
+            if(!contains_entity(id) || translation.contains(id)) { continue; }
+            entity_id new_id = other.create_entity();
+            if(new_id == null_entity) { break; }
+
+            translation.emplace(id, new_id);
+            from.push_back(id);
+            to.push_back(new_id);
+            touched |= get_component_bitset(id, false);
+        }
+
+        std::vector<size_t> remap(component_pools_.size(), tombstone);
+        for(auto& [type, position] : component_bit_positions_)
+            if(touched[position]) { remap[position] = other.adopt_pool(type, *component_pools_[position]); }
+
+        // bitsets translated to the bit positions of other
+        std::vector<component_bitset> moved(from.size());
+        for(size_t k = 0; k < from.size(); k++)
+        {
+            entity_id id = from[k];
+            component_bitset bitset = get_component_bitset(id, false);
+            moved[k][DISABLED_BIT] = bitset[DISABLED_BIT];
+            for(size_t i = 0; i < component_pools_.size(); i++)
+            {
+                if(!bitset[i]) { continue; }
+                notify(component_listeners_[i].on_remove, id);
+                moved[k][remap[i]] = 1;
+            }
+
+            uint64_t key = external_ids_.external_id(id);
+            if(key != external_id_map::no_key) { external_ids_.unbind(id); other.external_ids_.bind(to[k], key); }
+
+            if(hierarchy_.contains(id))
+            {
+                entity_id parent = hierarchy_.parent(id);
+                if(translation.contains(parent)) { other.hierarchy_.set_parent(to[k], translation.at(parent)); }
+
+                std::span<const entity_id> children = hierarchy_.children(id);
+                for(entity_id child : std::vector<entity_id>(children.begin(), children.end()))
+                    if(!translation.contains(child)) { hierarchy_.set_parent(child, null_entity); }
+                hierarchy_.remove(id);
+            }
+
+            remove_entity_from_group(bitset, id);
+            update_views(bitset, component_bitset(), id);
+            component_bitsets_.remove(id);
+            available_entity_ids_.push(id);
+        }
+
+        for(size_t i = 0; i < component_pools_.size(); i++)
+            if(touched[i]) { writable_pool(i)->transfer(*other.writable_pool(remap[i]), from, to); }
+
+        for(size_t k = 0; k < from.size(); k++)
+        {
+            other.component_bitsets_.push(to[k], moved[k]);
+            other.add_entity_to_group(moved[k], to[k]);
+            other.update_views(component_bitset(), moved[k], to[k]);
+            for(size_t i = 0; i < other.component_pools_.size(); i++)
+                if(moved[k][i]) { other.notify(other.component_listeners_[i].on_update, to[k]); }
+        }
+
+        return translation;
+    }
+
+    // moves every entity of other into this registry, other is left empty
+    id_translation merge(registry& other)
+    {
+        std::vector<entity_id> ids = other.component_bitsets_.ids();
+        return other.move_to(*this, ids);
+    }
+
+    entity_id create_entity()
+    {
+        if(available_entity_ids_.empty())
+        {
+            if(!generate_available_entity_chuck())
+            {
+                LAMECS_INFO("Maximum enitity limit reached, cant create entity");
+                return null_entity;
+            }
+        }
+
+        entity_id id = available_entity_ids_.front();
+        available_entity_ids_.pop();
+        return id;
+    }
+
+    template<typename ...Components>
+    std::tuple<component_ref_t<Components>...> get_entity(entity_id id)
+    { 
+        LAMECS_ASSERT(!contains_entity(id), "Entity does not exist in .get_entity()");
+        return std::tuple<component_ref_t<Components>...>(get<Components>(id)...);
+    }
+
+    // pointer to the component or nullptr (an empty optional for soa pools) when id does not have it, one sparse read per component
+    // a single component gives the pointer itself, several give a tuple of pointers
+    template<typename ...Components>
+    auto try_get(entity_id id)
+    {
+        if constexpr(sizeof...(Components) == 1)
+            return (try_get_one<Components>(id), ...);
+        else
+            return std::tuple<component_ptr_t<Components>...>(try_get_one<Components>(id)...);
+    }
+
+    // same as .try_get() with const pointers, pools shared with a fork or snapshot are not copied
+    template<typename ...Components>
+    auto try_read(entity_id id)
+    {
+        if constexpr(sizeof...(Components) == 1)
+            return (try_read_one<Components>(id), ...);
+        else
+            return std::tuple<decltype(try_read_one<Components>(id))...>(try_read_one<Components>(id)...);
+    }
+
+    template<typename ...Components>
+    std::vector<std::tuple<entity_id, component_ref_t<Components>...>> view()
+    {
+        std::vector<std::tuple<entity_id, component_ref_t<Components>...>> result;
+        const component_bitset& target_mask = get_component_bitset_mask<Components...>();
+
+        for(auto&[mask, group] : enitity_groups_)
+        {
+            if(group_matches(mask, target_mask))
+            {
+                for(auto id : group.ids()) { result.emplace_back(id, get<Components>(id)...); }   
+            }
+        }
+
+        return result;
+    }
+
+    // folds map_fn over every entity with Components into init using combine_fn(accumulator, mapped)
+    // map_fn is [](Component c1, ...) or [](entity_id id, Component c1, ...)
+    template<typename ...Components, typename T, typename Map, typename Combine>
+    T reduce(T init, Map&& map_fn, Combine&& combine_fn)
+    {
+        std::tuple<storage_t<Components>&...> pools = pools_for<Map, Components...>();
+        T result = std::move(init);
+
+        for(std::span<const entity_id> chunk : matching_chunks<Components...>())
+            for(entity_id id : chunk) { result = combine_fn(std::move(result), map_entity<Components...>(map_fn, pools, id)); }
+        return result;
+    }
+
+    // parallel .reduce(), every ITERATION_CHUNK_SIZE entities get their own accumulator starting from init and the
+    // partial results are combined in chunk order, so init must be the identity of combine_fn and combine_fn associative
+    // the result does not depend on the thread count, map_fn runs concurrently and must not modify the registry
+    template<typename ...Components, typename T, typename Map, typename Combine>
+    T par_reduce(T init, Map&& map_fn, Combine&& combine_fn, size_t thread_count = std::thread::hardware_concurrency())
+    {
+        static_assert(std::is_invocable_v<Map&, entity_id, component_cref_t<Components>...> || std::is_invocable_v<Map&, component_cref_t<Components>...>,
+                      "map_fn of .par_reduce() runs concurrently and must take its components by const reference or by value");
+        std::tuple<storage_t<Components>&...> pools(get_readable_pool<Components>()...);
+        std::vector<std::span<const entity_id>> chunks = matching_chunks<Components...>();
+        std::vector<T> partials(chunks.size(), init);
+        std::atomic<size_t> next_chunk = 0;
+
+        auto worker = [&]()
+        {
+            for(size_t c = next_chunk++; c < chunks.size(); c = next_chunk++)
+                for(entity_id id : chunks[c]) { partials[c] = combine_fn(std::move(partials[c]), read_entity<Components...>(map_fn, pools, id)); }
+        };
+
+        std::vector<std::thread> threads;
+        for(size_t i = 1; i < std::min(std::max<size_t>(thread_count, 1), chunks.size()); i++) { threads.emplace_back(worker); }
+        worker();
+        for(std::thread& thread : threads) { thread.join(); }
+
+        T result = std::move(init);
+        for(T& partial : partials) { result = combine_fn(std::move(result), std::move(partial)); }
+        return result;
+    }
+
+    // copies the C component of every id into out, every id must have C
+    template<typename C>
+    void gather(std::span<const entity_id> ids, std::span<C> out)
+    {
+        LAMECS_ASSERT(out.size() < ids.size(), "Output span is smaller than id span in .gather()");
+        storage_t<C>& pool = get_readable_pool<C>();
+
+        for(size_t i = 0; i < ids.size(); i++)
+        {
+            prefetch_ahead(pool, ids, i);
+            out[i] = read_component<C>(pool, ids[i]);
+        }
+    }
+
+    // writes values[i] into the C component of ids[i], every id must already have C, .on_update() listeners are notified
+    template<typename C>
+    void scatter(std::span<const entity_id> ids, std::span<const C> values)
+    {
+        LAMECS_ASSERT(values.size() < ids.size(), "Value span is smaller than id span in .scatter()");
+        storage_t<C>& pool = get_component_pool<C>(false);
+        component_listeners& listeners = component_listeners_[get_component_position<C>()];
+
+        for(size_t i = 0; i < ids.size(); i++)
+        {
+            prefetch_ahead(pool, ids, i);
+            // set() on a read only pool would add C behind the back of the bitset and groups
+            LAMECS_ASSERT(!pool.contains(ids[i]), "Entity: " << ids[i] << " does not have component " << get_component_type<C>() << " during .scatter() call");
+            if constexpr(std::is_assignable_v<component_ref_t<C>, const C&>)
+                pool[ids[i]] = values[i];
+            else
+                pool.set(ids[i], values[i]);
+        }
+
+        if(!listeners.on_update.empty())
+            for(entity_id id : ids) { notify(listeners.on_update, id); }
+    }
+
+    // calls func for every id of an arbitrary id list that has all Components, ids without them are skipped
+    // [](entity_id id, Component c1, ...) or [](Component c1, ...)
+    template<typename ...Components, typename Func>
+    void for_ids(std::span<const entity_id> ids, Func&& func)
+    {
+        std::tuple<storage_t<Components>&...> pools = pools_for<Func, Components...>();
+
+        for(size_t i = 0; i < ids.size(); i++)
+        {
+            std::apply([&](auto&... pool) { (prefetch_ahead(pool, ids, i), ...); }, pools);
+            bool has_all = std::apply([&](auto&... pool) { return (pool.contains(ids[i]) && ...); }, pools);
+            if(has_all) { map_entity<Components...>(func, pools, ids[i]); }
+        }
+    }
+
+    // number of enabled entities with Components, answered from group sizes without touching any component
+    template<typename ...Components>
+    size_t count()
+    {
+        if(!registered<Components...>()) { return 0; }
+        const component_bitset& target_mask = get_component_bitset_mask<Components...>();
+        size_t result = 0;
+
+        for(auto& [mask, group] : enitity_groups_)
+            if(group_matches(mask, target_mask)) { result += group.size(); }
+        return result;
+    }
+
+    template<typename ...Components>
+    bool any()
+    {
+        if(!registered<Components...>()) { return false; }
+        const component_bitset& target_mask = get_component_bitset_mask<Components...>();
+
+        for(auto& [mask, group] : enitity_groups_)
+            if(group_matches(mask, target_mask)) { return true; }
+        return false;
+    }
+
+    // the only enabled entity with Components or null_entity if there is none, more than one match is an error
+    template<typename ...Components>
+    entity_id single()
+    {
+        if(!registered<Components...>()) { return null_entity; }
+        const component_bitset& target_mask = get_component_bitset_mask<Components...>();
+        entity_id result = null_entity;
+
+        for(auto& [mask, group] : enitity_groups_)
+        {
+            if(!group_matches(mask, target_mask)) { continue; }
+            LAMECS_ASSERT(result != null_entity || group.size() > 1, "More than one entity matches .single()");
+            result = group.ids().front();
+        }
+        return result;
+    }
+
+    template<typename ...Components, typename Func>
+    void each(Func&& func)
+    {
+        const component_bitset& target_mask = get_component_bitset_mask<Components...>();
+
+        for(auto& [mask, group] : enitity_groups_)
+        {
+            if(group_matches(mask, target_mask))
+            {
+                for(entity_id id : group.ids()) { invoke<Components...>(func, id); }
+            }
+        }
+    }
+
+    // same as .each() but only visits disabled entities
+    template<typename ...Components, typename Func>
+    void each_disabled(Func&& func)
+    {
+        component_bitset target_mask = get_component_bitset_mask<Components...>();
+        target_mask[DISABLED_BIT] = 1;
+
+        for(auto& [mask, group] : enitity_groups_)
+        {
+            if((mask & target_mask) == target_mask)
+            {
+                for(entity_id id : group.ids()) { invoke<Components...>(func, id); }
+            }
+        }
+    }
+
+    // visits at most max_entities entities and stores where it stopped in cursor, returns true once the sweep is finished
+    // groups are walked back to front so swap and pop removals between calls never skip an entity, at worst one is visited twice
+    // entities that move to another group during a sweep may be picked up in the next sweep instead
+    template<typename ...Components, typename Func>
+    bool each_budgeted(iteration_cursor& cursor, size_t max_entities, Func&& func)
+    {
+        return each_budgeted_impl<Components...>(cursor, func, [max_entities](size_t visited) { return visited >= max_entities; });
+    }
+
+    // same as above but stops once budget is spent, the clock is read every BUDGET_CLOCK_STRIDE entities
+    template<typename ...Components, typename Func>
+    bool each_budgeted(iteration_cursor& cursor, std::chrono::nanoseconds budget, Func&& func)
+    {
+        auto deadline = std::chrono::steady_clock::now() + budget;
+        return each_budgeted_impl<Components...>(cursor, func, [deadline](size_t visited)
+        {
+            return visited % BUDGET_CLOCK_STRIDE == 0 && visited > 0 && std::chrono::steady_clock::now() >= deadline;
+        });
+    }
+
+    // disabled entities keep their components but are skipped by queries, only the group of the entity changes
+    void disable(entity_id id) { set_enabled(id, false); }
+
+    void enable(entity_id id) { set_enabled(id, true); }
+
+    bool is_enabled(entity_id id) { return contains_entity(id) && !get_component_bitset(id, false)[DISABLED_BIT]; }
+
+    // moves the component of id into the active prefix of its pool, only for sparse_set pools
+    template<typename C>
+    void promote(entity_id id) { get_component_pool<C>(false).promote(id); }
+
+    // moves the component of id into the cold suffix of its pool, cold components are skipped by .each_active() and .each_chunk()
+    // group based queries (.each(), .view(), .count(), ...) still see cold components, activity is per pool and groups are per entity
+    template<typename C>
+    void demote(entity_id id) { get_component_pool<C>(false).demote(id); }
+
+    template<typename C>
+    bool is_active(entity_id id) { return get_component_pool<C>(false).is_active(id); }
+
+    // walks the active prefix of the Lead pool in dense order instead of groups, Lead components are read straight from the dense pages
+    // like .each_chunk() disabled entities are included, entities without all Others are skipped with one sparse lookup per other pool
+    // [](entity_id id, Lead& lead, Others&... others) or [](Lead& lead, Others&... others)
+    template<typename Lead, typename ...Others, typename Func>
+    void each_active(Func&& func)
+    {
+        static_assert(std::is_same_v<storage_t<Lead>, sparse_set<Lead>>, "only components stored in a sparse_set have an active prefix");
+        constexpr bool read_only = reads_only<Func, Lead, Others...>();
+        std::tuple<storage_t<Lead>&, storage_t<Others>&...> pools = pools_for<Func, Lead, Others...>();
+
+        std::apply([&](storage_t<Lead>& lead, storage_t<Others>&... others)
+        {
+            const std::vector<entity_id>& ids = lead.ids();
+            size_t end = lead.active_size();
+
+            for(size_t offset = 0; offset < end; offset += ITERATION_CHUNK_SIZE)
             {
-                for(entity_id id : group.data())
+                size_t count = std::min(ITERATION_CHUNK_SIZE, end - offset);
+                std::span<std::conditional_t<read_only, const Lead, Lead>> items;
+                if constexpr(read_only) { items = lead.read_chunk(offset, count); }
+                else { items = std::get<0>(lead.chunk(offset, count)); }
+
+                for(size_t i = 0; i < count; i++)
                 {
-                    // [](entity_id id, Component c1, Component c2, ...)
-                    if constexpr(std::is_invocable_v<Func, entity_id, Components&...>)
-                        func(id, get<Components>(id)...);
-                    // [](Component c1, Component c2, ...)
-                    else if constexpr(std::is_invocable_v<Func, Components&...>)
-                        func(get<Components>(id)...);
+                    entity_id id = ids[offset + i];
+                    if constexpr(sizeof...(Others) > 0)
+                        if(!(others.contains(id) && ...)) { continue; }
+
+                    if constexpr(read_only)
+                    {
+                        if constexpr(std::is_invocable_v<Func&, entity_id, const Lead&, component_cref_t<Others>...>)
+                            func(id, items[i], read_component<Others>(others, id)...);
+                        else
+                            func(items[i], read_component<Others>(others, id)...);
+                    }
+                    else if constexpr(std::is_invocable_v<Func&, entity_id, Lead&, component_ref_t<Others>...>)
+                        func(id, items[i], others[id]...);
                     else
-                        LAMECS_ASSERT(true, "Bad lambda provided for .each(), parameter pack dosent match to lambda args");
+                        func(items[i], others[id]...);
+                }
+            }
+        }, pools);
+    }
+
+    // visits enabled entities with Key and Components partitioned by the value of Key in ascending key order, Key needs operator< and operator==
+    // one partition per query is built on first use and then kept up to date as entities enter or leave the query and through .emplace() and .patch() of Key
+    // [](const Key& key, std::span<const entity_id> ids, std::span<const Components>... components) or [](const Key& key, std::span<const entity_id> ids)
+    // only the ids are maintained, component spans are read only copies gathered bucket by bucket on every call (O(matching entities))
+    // so the ids form is cheaper when components are not needed, changes go back through .scatter()
+    template<typename Key, typename ...Components, typename Func>
+    void each_grouped(Func&& func)
+    {
+        if(!registered<Key, Components...>()) { return; }
+        grouped_partition& partition = get_grouped_partition<Key, Components...>();
+        auto& buckets = static_cast<value_index<Key, Key, std::map>&>(*partition.index).buckets();
+
+        if constexpr(sizeof...(Components) > 0 && std::is_invocable_v<Func&, const Key&, std::span<const entity_id>, std::span<const Components>...>)
+        {
+            std::tuple<storage_t<Components>&...> pools(get_readable_pool<Components>()...);
+            std::tuple<std::vector<Components>...> gathered;
+
+            for(auto& [key, ids] : buckets)
+            {
+                std::span<const entity_id> bucket(ids);
+                std::apply([&](storage_t<Components>&... pool)
+                {
+                    std::apply([&](std::vector<Components>&... out)
+                    {
+                        (gather_bucket<Components>(pool, out, bucket), ...);
+                        func(key, bucket, std::span<const Components>(out)...);
+                    }, gathered);
+                }, pools);
+            }
+        }
+        else
+        {
+            for(auto& [key, ids] : buckets) { func(key, std::span<const entity_id>(ids)); }
+        }
+    }
+
+    // creates a view holding every enabled entity with Components, it lives until .drop_view() or the registry is destroyed
+    // reading it is a span walk, the registry updates it whenever an entity enters or leaves the query
+    template<typename ...Components>
+    materialized_view& materialize()
+    {
+        return add_view(get_component_bitset_mask<Components...>(), nullptr);
+    }
+
+    // same as .materialize() but ids are ordered by their Sort component with compare(const Sort&, const Sort&)
+    // changes of Sort are only picked up when made through .emplace() or .patch()
+    template<typename Sort, typename ...Components, typename Compare = std::less<>>
+    materialized_view& materialize_sorted(Compare compare = {})
+    {
+        auto less = [compare](registry& reg, entity_id a, entity_id b)
+        {
+            const Sort& sort_a = reg.read<Sort>(a);
+            const Sort& sort_b = reg.read<Sort>(b);
+            return compare(sort_a, sort_b);
+        };
+        materialized_view& view = add_view(get_component_bitset_mask<Sort, Components...>(), less);
+        view.update_connection = connect_update(get_component_position<Sort>(), [&view](registry& reg, entity_id id) { view.reorder(reg, id); });
+        return view;
+    }
+
+    void drop_view(materialized_view& view)
+    {
+        if(view.update_connection != tombstone) { disconnect(view.update_connection); }
+        std::erase_if(materialized_views_, [&view](auto& ptr) { return ptr.get() == &view; });
+    }
+
+    // [](entity_id id, Component c1, ...) or [](Component c1, ...) for every entity of a materialized view
+    template<typename ...Components, typename Func>
+    void each(const materialized_view& view, Func&& func)
+    {
+        for(entity_id id : view) { invoke<Components...>(func, id); }
+    }
+
+    // visits a shared_set pool once per distinct value with every entity holding it, disabled entities included
+    // [](const C& value, std::span<const entity_id> ids)
+    template<typename C, typename Func>
+    void each_shared(Func&& func) { get_readable_pool<C>().each_shared(func); }
+
+    // walks the pool of C in dense order, func gets the entity ids and one span per field (a single span for non soa pools)
+    // this does not go through groups so disabled entities are included, cold components are only visited with include_cold
+    // spans start 64 byte aligned and trivially copyable fields may be read up to the next simd lane multiple
+    // [](std::span<const entity_id> ids, std::span<float> x, std::span<float> y, ...)
+    template<typename C, typename Func>
+    void each_chunk(Func&& func, bool include_cold = false)
+    {
+        storage_t<C>& pool = get_component_pool<C>(false);
+        const std::vector<entity_id>& ids = pool.ids();
+        size_t end = ids.size();
+        if constexpr(requires { pool.active_size(); })
+            if(!include_cold) { end = pool.active_size(); }
+
+        for(size_t offset = 0; offset < end; offset += ITERATION_CHUNK_SIZE)
+        {
+            size_t count = std::min(ITERATION_CHUNK_SIZE, end - offset);
+            std::span<const entity_id> chunk_ids(ids.data() + offset, count);
+            std::apply([&](auto... fields) { func(chunk_ids, fields...); }, pool.chunk(offset, count));
+        }
+    }
+};
+
+
+struct vec3
+{
+    float x, y, z;
+};
+
+// packs 21 bits of each grid coordinate into one key
+inline uint64_t grid_cell_key(int x, int y, int z)
+{
+    constexpr uint64_t mask = (uint64_t(1) << 21) - 1;
+    return (uint64_t(x) & mask) | ((uint64_t(y) & mask) << 21) | ((uint64_t(z) & mask) << 42);
+}
+
+// uniform grid over a position component, kept up to date by the registry update/remove listeners
+// positions only change in the index when they are written with .emplace() or .patch()
+template <typename C>
+class spatial_index
+{
+private:
+    struct entry
+    {
+        vec3 position;
+        uint64_t cell;
+        size_t slot; // position in cells_[cell]
+    };
+
+    registry& registry_;
+    float cell_size_;
+    std::function<vec3(const C&)> position_fn_;
+    std::unordered_map<uint64_t, std::vector<entity_id>> cells_;
+    sparse_set<entry> entries_;
+    size_t update_connection_;
+    size_t remove_connection_;
+
+    int cell_coord(float value) { return static_cast<int>(std::floor(value / cell_size_)); }
+
+    uint64_t cell_of(const vec3& p) { return grid_cell_key(cell_coord(p.x), cell_coord(p.y), cell_coord(p.z)); }
+
+    static float distance_squared(const vec3& a, const vec3& b)
+    {
+        float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    void erase_from_cell(entry& e)
+    {
+        std::vector<entity_id>& cell = cells_[e.cell];
+        entries_[cell.back()].slot = e.slot;
+        cell[e.slot] = cell.back();
+        cell.pop_back();
+        if(cell.empty()) { cells_.erase(e.cell); }
+    }
+
+    void update(entity_id id, const C& component)
+    {
+        vec3 position = position_fn_(component);
+        uint64_t cell = cell_of(position);
+
+        if(entries_.contains(id))
+        {
+            entry& e = entries_[id];
+            e.position = position;
+            if(e.cell == cell) { return; }
+            erase_from_cell(e);
+        }
+
+        std::vector<entity_id>& ids = cells_[cell];
+        entries_.set(id, { position, cell, ids.size() });
+        ids.push_back(id);
+    }
+
+    void erase(entity_id id)
+    {
+        if(!entries_.contains(id)) { return; }
+        erase_from_cell(entries_[id]);
+        entries_.remove(id);
+    }
+
+    // calls func(id, position) for every entry in the cells overlapping [min, max]
+    template<typename Func>
+    void each_in_cells(const vec3& min, const vec3& max, Func&& func)
+    {
+        int x0 = cell_coord(min.x), y0 = cell_coord(min.y), z0 = cell_coord(min.z);
+        int x1 = cell_coord(max.x), y1 = cell_coord(max.y), z1 = cell_coord(max.z);
+
+        // scanning every occupied cell is cheaper than probing a mostly empty range
+        if(uint64_t(x1 - x0 + 1) * uint64_t(y1 - y0 + 1) * uint64_t(z1 - z0 + 1) > cells_.size())
+        {
+            for(auto& [key, ids] : cells_)
+                for(entity_id id : ids) { func(id, entries_[id].position); }
+            return;
+        }
+
+        for(int x = x0; x <= x1; x++)
+            for(int y = y0; y <= y1; y++)
+                for(int z = z0; z <= z1; z++)
+                {
+                    auto it = cells_.find(grid_cell_key(x, y, z));
+                    if(it == cells_.end()) { continue; }
+                    for(entity_id id : it->second) { func(id, entries_[id].position); }
                 }
+    }
+
+    void query_candidates(const vec3& center, float extent, std::vector<std::pair<float, entity_id>>& found)
+    {
+        vec3 min = { center.x - extent, center.y - extent, center.z - extent };
+        vec3 max = { center.x + extent, center.y + extent, center.z + extent };
+        each_in_cells(min, max, [&](entity_id id, const vec3& p) { found.emplace_back(distance_squared(p, center), id); });
+    }
+
+public:
+    // position_fn maps the component to a point, components with x, y, z members work without one
+    spatial_index(registry& reg, float cell_size, std::function<vec3(const C&)> position_fn = [](const C& c) { return vec3{ float(c.x), float(c.y), float(c.z) }; })
+        : registry_(reg), cell_size_(cell_size), position_fn_(std::move(position_fn))
+    {
+        update_connection_ = registry_.on_update<C>([this](entity_id id, const C& component) { update(id, component); });
+        remove_connection_ = registry_.on_remove<C>([this](entity_id id) { erase(id); });
+
+        auto insert = [this](entity_id id, const C& component) { update(id, component); };
+        registry_.each<C>(insert);
+        registry_.each_disabled<C>(insert);
+    }
+
+    spatial_index(const spatial_index&) = delete;
+    spatial_index& operator=(const spatial_index&) = delete;
+
+    ~spatial_index()
+    {
+        registry_.disconnect(update_connection_);
+        registry_.disconnect(remove_connection_);
+    }
+
+    void query_aabb(const vec3& min, const vec3& max, std::vector<entity_id>& out)
+    {
+        each_in_cells(min, max, [&](entity_id id, const vec3& p)
+        {
+            if(p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y && p.z >= min.z && p.z <= max.z) { out.push_back(id); }
+        });
+    }
+
+    void query_radius(const vec3& center, float radius, std::vector<entity_id>& out)
+    {
+        vec3 min = { center.x - radius, center.y - radius, center.z - radius };
+        vec3 max = { center.x + radius, center.y + radius, center.z + radius };
+        each_in_cells(min, max, [&](entity_id id, const vec3& p)
+        {
+            if(distance_squared(p, center) <= radius * radius) { out.push_back(id); }
+        });
+    }
+
+    // k closest entities sorted by distance, the search box grows one cell ring at a time until no closer entity can exist
+    void nearest_k(const vec3& center, size_t k, std::vector<entity_id>& out)
+    {
+        std::vector<std::pair<float, entity_id>> found;
+        k = std::min(k, entries_.size());
+
+        // the extent doubles every round so entities D cells away cost O(log D) queries
+        for(float extent = cell_size_; k > 0;)
+        {
+            found.clear();
+            query_candidates(center, extent, found);
+
+            // everything within extent of center has been collected, so the k-th candidate is final once it is that close
+            if(found.size() >= k)
+            {
+                std::nth_element(found.begin(), found.begin() + (k - 1), found.end());
+                if(found[k - 1].first <= extent * extent || found.size() == entries_.size()) { break; }
+                // the k nearest are no farther than the current k-th candidate, so one more query reaching it is enough
+                extent = std::max(extent * 2, std::sqrt(found[k - 1].first));
             }
+            else { extent *= 2; }
+        }
+
+        std::sort(found.begin(), found.end());
+        for(size_t i = 0; i < k; i++) { out.push_back(found[i].second); }
+    }
+
+    std::vector<entity_id> query_aabb(const vec3& min, const vec3& max) { std::vector<entity_id> out; query_aabb(min, max, out); return out; }
+
+    std::vector<entity_id> query_radius(const vec3& center, float radius) { std::vector<entity_id> out; query_radius(center, radius, out); return out; }
+
+    std::vector<entity_id> nearest_k(const vec3& center, size_t k) { std::vector<entity_id> out; nearest_k(center, k, out); return out; }
+
+    size_t size() { return entries_.size(); }
+};
+
+// entity of a partitioned_world, the id belongs to the registry of cell and changes when .sync() moves it
+struct world_entity
+{
+    uint64_t cell;
+    entity_id id;
+};
+
+// world split into one registry per cell of a uniform grid over the position component C
+// partitions share nothing, so .par_each() gives every partition to a single thread without locking
+// entities only change partition in .sync(), positions may cross cell borders freely in between
+template <typename C>
+class partitioned_world
+{
+private:
+    float cell_size_;
+    std::function<vec3(const C&)> position_fn_;
+    std::unordered_map<uint64_t, std::unique_ptr<registry>> partitions_;
+
+    int cell_coord(float value) { return static_cast<int>(std::floor(value / cell_size_)); }
+
+    uint64_t cell_of(const C& component)
+    {
+        vec3 p = position_fn_(component);
+        return grid_cell_key(cell_coord(p.x), cell_coord(p.y), cell_coord(p.z));
+    }
+
+    // queries assert on component types a registry never saw and a partition may not have seen all of them yet
+    template<typename ...Components>
+    static registry& with_pools(registry& partition)
+    {
+        (partition.template storage<Components>(), ...);
+        return partition;
+    }
+
+    // func(uint64_t cell, registry&) once per partition, partitions are handed out one at a time so big ones dont hold up a thread
+    template<typename Func>
+    void par_partitions(Func& func, size_t thread_count)
+    {
+        std::vector<std::pair<uint64_t, registry*>> work;
+        for(auto& [cell, partition] : partitions_) { work.emplace_back(cell, partition.get()); }
+        std::atomic<size_t> next = 0;
+
+        auto worker = [&]()
+        {
+            for(size_t i = next++; i < work.size(); i = next++) { func(work[i].first, *work[i].second); }
+        };
+
+        std::vector<std::thread> threads;
+        for(size_t i = 1; i < std::min(std::max<size_t>(thread_count, 1), work.size()); i++) { threads.emplace_back(worker); }
+        worker();
+        for(std::thread& thread : threads) { thread.join(); }
+    }
+
+public:
+    partitioned_world(float cell_size, std::function<vec3(const C&)> position_fn = [](const C& c) { return vec3{ float(c.x), float(c.y), float(c.z) }; })
+        : cell_size_(cell_size), position_fn_(std::move(position_fn)) {}
+
+    // registry of cell, created when missing
+    registry& partition(uint64_t cell)
+    {
+        std::unique_ptr<registry>& partition = partitions_[cell];
+        if(!partition) { partition = std::make_unique<registry>(); }
+        return *partition;
+    }
+
+    registry& partition_of(const C& position) { return partition(cell_of(position)); }
+
+    size_t partition_count() { return partitions_.size(); }
+
+    // creates an entity with position in the partition it belongs to
+    world_entity create_entity(C position)
+    {
+        uint64_t cell = cell_of(position);
+        registry& reg = partition(cell);
+        entity_id id = reg.create_entity();
+        if(id != null_entity) { reg.emplace<C>(id, std::move(position)); }
+        return { cell, id };
+    }
+
+    void remove_entity(world_entity entity)
+    {
+        auto it = partitions_.find(entity.cell);
+        if(it != partitions_.end()) { it->second->remove_entity(entity.id); }
+    }
+
+    // external ids move with their entity, this is the way to keep a handle across .sync()
+    world_entity resolve(uint64_t key)
+    {
+        for(auto& [cell, partition] : partitions_)
+        {
+            entity_id id = partition->resolve(key);
+            if(id != null_entity) { return { cell, id }; }
+        }
+        return { 0, null_entity };
+    }
+
+    // same as registry::each() over every partition, one after another
+    template<typename ...Components, typename Func>
+    void each(Func&& func)
+    {
+        for(auto& [cell, partition] : partitions_) { with_pools<Components...>(*partition).template each<Components...>(func); }
+    }
+
+    // registry::each() on every partition in parallel, func is called from several threads but never for two entities of one partition at once
+    template<typename ...Components, typename Func>
+    void par_each(Func&& func, size_t thread_count = std::thread::hardware_concurrency())
+    {
+        auto run = [&](uint64_t, registry& partition) { with_pools<Components...>(partition).template each<Components...>(func); };
+        par_partitions(run, thread_count);
+    }
+
+    // func(uint64_t cell, registry&) on every partition in parallel, for systems that need more than one query per partition
+    template<typename Func>
+    void par_for_partitions(Func&& func, size_t thread_count = std::thread::hardware_concurrency()) { par_partitions(func, thread_count); }
+
+    template<typename ...Components>
+    size_t count()
+    {
+        size_t result = 0;
+        for(auto& [cell, partition] : partitions_) { result += with_pools<Components...>(*partition).template count<Components...>(); }
+        return result;
+    }
+
+    // moves entities whose C left the cell of their partition, in bulk per (source, target) pair
+    // on_moved(world_entity from, world_entity to) is called for every moved entity, returns how many moved
+    template<typename Func>
+    size_t sync(Func&& on_moved)
+    {
+        std::vector<std::pair<uint64_t, std::unordered_map<uint64_t, std::vector<entity_id>>>> moves;
+        for(auto& [cell, partition] : partitions_)
+        {
+            std::unordered_map<uint64_t, std::vector<entity_id>> leaving;
+            auto check = [&, cell = cell](entity_id id, const C& component)
+            {
+                uint64_t target = cell_of(component);
+                if(target != cell) { leaving[target].push_back(id); }
+            };
+            with_pools<C>(*partition).template each<C>(check);
+            partition->template each_disabled<C>(check);
+            if(!leaving.empty()) { moves.emplace_back(cell, std::move(leaving)); }
         }
+
+        size_t moved = 0;
+        for(auto& [cell, leaving] : moves)
+            for(auto& [target, ids] : leaving)
+            {
+                registry::id_translation translation = partitions_.at(cell)->move_to(partition(target), ids);
+                for(entity_id id : ids)
+                    if(translation.contains(id)) { on_moved(world_entity{ cell, id }, world_entity{ target, translation.at(id) }); }
+                moved += translation.size();
+            }
+        return moved;
     }
+
+    size_t sync() { return sync([](world_entity, world_entity) {}); }
 };
 
 
+template <typename C>
+void storage_ref<C>::emplace(entity_id id, C component)
+{
+    if(id == null_entity)
+    {
+        LAMECS_INFO("Entity is not valid");
+        return;
+    }
+    registry_->emplace_at<C>(pool(), position_, id, std::move(component));
+}
+
+template <typename C>
+void storage_ref<C>::remove(entity_id id)
+{
+    if(!registry_->contains_entity(id))
+    {
+        LAMECS_INFO("Entity: " << id << " does not exist");
+        return;
+    }
+    registry_->remove_at<C>(pool(), position_, id);
+}
+
+template <typename C>
+storage_t<C>& storage_ref<C>::pool() { return *static_cast<storage_t<C>*>(registry_->writable_pool(position_)); }
+
+template <typename C>
+storage_t<C>& storage_ref<C>::readable_pool() { return *static_cast<storage_t<C>*>(registry_->readable_pool(position_)); }
+
+
 }; // namespace lamecs
 
+template <typename C>
+struct std::tuple_size<lamecs::soa_ref<C>> : std::integral_constant<size_t, lamecs::soa_ref<C>::field_count> {};
+
+template <size_t I, typename C>
+struct std::tuple_element<I, lamecs::soa_ref<C>> { using type = typename lamecs::member_traits<std::tuple_element_t<I, lamecs::soa_members_t<C>>>::type&; };
+
 #endif // LAMECS_H
\ No newline at end of file